@@ -0,0 +1,611 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This app spreads the coprime base of a key corpus over worker processes
+// on several machines.
+//
+// A worker (`-p PORT`) listens on a TCP port and answers one job per
+// connection: it reads a chunk of keys, computes their coprime base with
+// `cb` and sends the base back. The coordinator (`-c HOST:PORT`, once per
+// worker) sorts and uniques the keys and splits them into `2^(LEVEL-1)`
+// chunks like `balanced-split`, by count or with `-w` by bits. Every
+// worker gets the next waiting chunk as soon as it is idle. The bases of
+// the chunks are merged by the coordinator with `cbmerge_tree`, the keys
+// are factored over the merged base and the results are printed like by
+// `app`.
+//
+// Both directions of a job use the raw gmp format: the count of the
+// integers followed by the integers, so a truncated answer is detected.
+// If a worker does not answer, e.g. because it is restarted, its chunk is
+// given to the next idle worker and the worker is tried again after a
+// second. A worker which fails for `-t SEC` seconds in a row is given up.
+// A connection which sends or receives nothing for `-t SEC` seconds, e.g.
+// of a hung worker or coordinator, fails as well, so `SEC` has to be
+// longer than the computation of a chunk.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <gmp.h>
+#include "copri.h"
+#include "hash.h"
+#include "config.h"
+
+// The maximal count of workers of a coordinator.
+#define CLUSTER_MAX_WORKERS 256
+
+// A chunk `keys[from..to-1]` of the corpus. The state is 0 while the
+// chunk waits for a worker, 1 while a worker computes its base and 2 if
+// `base` is known.
+typedef struct {
+	size_t from;
+	size_t to;
+	int state;
+	mpz_array base;
+} cluster_job;
+
+typedef struct {
+	char *host;
+	char *port;
+	size_t done;
+	pthread_t thread;
+} cluster_worker;
+
+// The sorted keys and their chunks, the states of the chunks and `left`
+// are guarded by `lock`.
+static mpz_array keys;
+static cluster_job *jobs;
+static size_t njobs;
+static size_t left;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static double give_up = 60;
+static int vflg = 0;
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Prints the triples (key, p, q) of `out`.
+static void print_factors(mpz_array *out, int jflg, int rflg) {
+	size_t i;
+
+	if ((out->used % 3) != 0) {
+		fprintf(stderr, "Find factors returned an invalid array\n");
+	} else if (jflg > 0) {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out->array[i], out->array[i+1], out->array[i+2]);
+		fflush(stdout);
+	} else if (rflg > 0) {
+		for(i = 0; i < out->used; i++)
+			mpz_out_raw(stdout, out->array[i]);
+	} else {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out->array[i], out->array[i+1], out->array[i+2]);
+	}
+}
+
+// ## Protocol
+
+// Writes the count and the integers `s[0..count-1]` in the raw gmp format,
+// returns 0 on success.
+static int send_array(FILE *f, mpz_t *s, size_t count) {
+	mpz_t n;
+	size_t i;
+	int r = 0;
+
+	mpz_init_set_ui(n, count);
+	if (mpz_out_raw(f, n) == 0)
+		r = -1;
+	for (i = 0; i < count && r == 0; i++) {
+		if (mpz_out_raw(f, s[i]) == 0)
+			r = -1;
+	}
+	if (fflush(f) != 0)
+		r = -1;
+	mpz_clear(n);
+	return r;
+}
+
+// Appends the integers written by `send_array` to `a`, returns 0 if all
+// of them were read.
+static int recv_array(FILE *f, mpz_array *a) {
+	mpz_t x;
+	size_t count, i;
+	int r = 0;
+
+	mpz_init(x);
+	if (mpz_inp_raw(x, f) == 0 || !mpz_fits_ulong_p(x)) {
+		r = -1;
+	} else {
+		count = mpz_get_ui(x);
+		for (i = 0; i < count; i++) {
+			if (mpz_inp_raw(x, f) == 0) {
+				r = -1;
+				break;
+			}
+			array_add(a, x);
+		}
+	}
+	mpz_clear(x);
+	return r;
+}
+
+static int listen_tcp(const char *addr, int port) {
+	struct sockaddr_in sa;
+	int fd = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1 ||
+	bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 16) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Lets a send or receive on `fd` fail after `give_up` seconds without
+// progress.
+static void set_timeouts(int fd) {
+	struct timeval tv;
+
+	tv.tv_sec = (time_t)give_up;
+	tv.tv_usec = (suseconds_t)((give_up - tv.tv_sec) * 1e6);
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int connect_tcp(const char *host, const char *port) {
+	struct addrinfo hints, *res, *ai;
+	int fd = -1, on = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		return -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		set_timeouts(fd);
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	// A worker on a machine which went down is noticed by the keepalive.
+	if (fd >= 0)
+		setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+	return fd;
+}
+
+// ## Worker
+
+// Answers the jobs of the coordinators on `port` until the process is
+// stopped. A job without a complete chunk is dropped, the coordinator
+// sends it again.
+static int serve(const char *addr, int port) {
+	mpz_array s, p;
+	mpz_pool pool;
+	FILE *in, *out;
+	double start;
+	int fd, conn;
+
+	if ((fd = listen_tcp(addr, port)) < 0) {
+		fprintf(stderr, "Can't listen on %s:%d\n", addr, port);
+		return 1;
+	}
+	pool_init(&pool, 0);
+	if (vflg > 0) {
+		printf("waiting for jobs on %s:%d\n", addr, port);
+		fflush(stdout);
+	}
+	while (1) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno != EINTR)
+				perror("accept");
+			continue;
+		}
+		set_timeouts(conn);
+		in = fdopen(conn, "r");
+		out = fdopen(dup(conn), "w");
+		if (in == NULL || out == NULL) {
+			perror("fdopen");
+			if (in != NULL)
+				fclose(in);
+			else
+				close(conn);
+			continue;
+		}
+		array_init(&s, 16);
+		if (recv_array(in, &s) != 0 || s.used == 0) {
+			fprintf(stderr, "Incomplete job dropped\n");
+		} else {
+			start = now();
+			array_init(&p, s.used);
+			array_cb(&pool, &p, &s);
+			if (send_array(out, p.array, p.used) != 0)
+				fprintf(stderr, "Can't send the coprime base\n");
+			if (vflg > 0) {
+				printf("job of %zu keys, coprime base of %zu integers, %.3f s\n", s.used, p.used, now() - start);
+				fflush(stdout);
+			}
+			array_clear(&p);
+		}
+		array_clear(&s);
+		fclose(out);
+		fclose(in);
+	}
+	pool_clear(&pool);
+	close(fd);
+	return 0;
+}
+
+// ## Coordinator
+
+// Sends the chunk of `job` to `w` and reads its coprime base, returns 0
+// on success.
+static int run_job(cluster_worker *w, cluster_job *job) {
+	mpz_array base;
+	FILE *in, *out;
+	int fd, r;
+
+	if ((fd = connect_tcp(w->host, w->port)) < 0)
+		return -1;
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+	if (in == NULL || out == NULL) {
+		if (out != NULL)
+			fclose(out);
+		if (in != NULL)
+			fclose(in);
+		else
+			close(fd);
+		return -1;
+	}
+	r = send_array(out, keys.array + job->from, job->to - job->from);
+	shutdown(fd, SHUT_WR);
+	fclose(out);
+	array_init(&base, job->to - job->from);
+	if (r == 0)
+		r = recv_array(in, &base);
+	fclose(in);
+	if (r == 0)
+		job->base = base;
+	else
+		array_clear(&base);
+	return r;
+}
+
+// Takes the waiting chunks one by one for the worker `arg`. Without a
+// waiting chunk the thread waits until all chunks are done or the chunk
+// of a failed worker is given back.
+static void *dispatch(void *arg) {
+	cluster_worker *w = (cluster_worker *)arg;
+	double failing = 0, start;
+	size_t j, rest;
+
+	while (1) {
+		pthread_mutex_lock(&lock);
+		for (j = 0; j < njobs && jobs[j].state != 0; j++);
+		if (j < njobs)
+			jobs[j].state = 1;
+		rest = left;
+		pthread_mutex_unlock(&lock);
+		if (rest == 0)
+			break;
+		if (j == njobs) {
+			sleep(1);
+			continue;
+		}
+
+		start = now();
+		if (run_job(w, &jobs[j]) == 0) {
+			pthread_mutex_lock(&lock);
+			jobs[j].state = 2;
+			left--;
+			w->done++;
+			if (vflg > 0) {
+				printf("chunk %zu of %zu keys done by %s:%s, %.3f s\n", j, jobs[j].to - jobs[j].from, w->host, w->port, now() - start);
+				fflush(stdout);
+			}
+			pthread_mutex_unlock(&lock);
+			failing = 0;
+			continue;
+		}
+
+		pthread_mutex_lock(&lock);
+		jobs[j].state = 0;
+		pthread_mutex_unlock(&lock);
+		if (failing == 0) {
+			failing = now();
+			fprintf(stderr, "Worker %s:%s failed, chunk %zu is sent again\n", w->host, w->port, j);
+		} else if (now() - failing > give_up) {
+			fprintf(stderr, "Worker %s:%s given up\n", w->host, w->port);
+			break;
+		}
+		sleep(1);
+	}
+	return NULL;
+}
+
+// Sets the bounds of `count` chunks of the sorted keys like
+// `balanced-split`. By count the rest of the division is spread over the
+// chunks. By bits a chunk is closed as soon as it reaches its share of
+// the total bits, but one key is left for every following chunk.
+static void chunk_bounds(size_t *bounds, size_t count, int bits) {
+	unsigned long long total = 0, sum = 0;
+	size_t i, j = 0;
+
+	for (i = 0; i < keys.used; i++)
+		total += mpz_sizeinbase(keys.array[i], 2);
+	bounds[0] = 0;
+	for (i = 1; i < count; i++) {
+		if (bits == 0) {
+			bounds[i] = i * keys.used / count;
+			continue;
+		}
+		while (j < keys.used - (count - i)) {
+			sum += mpz_sizeinbase(keys.array[j++], 2);
+			if (sum * count >= i * total)
+				break;
+		}
+		bounds[i] = j;
+	}
+	bounds[count] = keys.used;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	cluster_worker workers[CLUSTER_MAX_WORKERS];
+	mpz_array p, out, *bases;
+	mpz_pool pool;
+	size_t count, dups, nworkers = 0, i, *bounds;
+	long int port = 0, level = 0;
+	double start;
+	int c, wflg = 0, sflg = 0, rflg = 0, jflg = 0, errflg = 0, r = 0;
+	char *filename = "primes.lst";
+	char *addr = "127.0.0.1";
+	char *cb_file = NULL;
+	char *colon;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":svrjwp:a:c:l:t:b:")) != -1) {
+		switch(c) {
+		case 'p':
+			port = strtol(optarg, NULL, 0);
+			break;
+		case 'a':
+			addr = optarg;
+			break;
+		case 'c':
+			colon = strrchr(optarg, ':');
+			if (colon == NULL || nworkers == CLUSTER_MAX_WORKERS) {
+				errflg++;
+				break;
+			}
+			*colon = 0;
+			memset(&workers[nworkers], 0, sizeof(cluster_worker));
+			workers[nworkers].host = optarg;
+			workers[nworkers++].port = colon + 1;
+			break;
+		case 'l':
+			level = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			give_up = strtod(optarg, NULL);
+			break;
+		case 'w':
+			wflg++;
+			break;
+		case 'b':
+			cb_file = optarg;
+			break;
+		case 's':
+			sflg++;
+			break;
+		case 'v':
+			vflg++;
+			break;
+		case 'r':
+			rflg++;
+			break;
+		case 'j':
+			jflg++;
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (optind < argc) {
+		filename = argv[optind];
+		if (optind + 1 < argc) errflg++;
+	}
+
+	if ((port == 0) == (nworkers == 0) || port < 0 || port > 65535 || level < 0 || level > 32) {
+		fprintf(stderr, "\n\tEither -p (worker) or -c (coordinator) has to be used!\n\n");
+		errflg++;
+	}
+
+	if (rflg && vflg) {
+		fprintf(stderr, "\n\t-r and -v can't be used simultaneously!\n\n");
+		errflg++;
+	}
+
+	if (give_up <= 0)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: -p PORT [-v] [-a ADDR] [-t SEC]\n"\
+                        "       -c HOST:PORT [-c HOST:PORT ...] [-vsrjw] [-l LEVEL] [-t SEC] [-b FILE] [file]\n"\
+                        "\n\t-p PORT       run as worker on the TCP port PORT"\
+                        "\n\t-a ADDR       listen on the address ADDR (default 127.0.0.1)"\
+                        "\n\t-c HOST:PORT  send chunks to the worker on HOST:PORT"\
+                        "\n\t-l LEVEL      split the keys into 2^(LEVEL-1) chunks (default 2 per worker)"\
+                        "\n\t-w            balance the chunks by bits instead of count"\
+                        "\n\t-t SEC        give a worker up after SEC seconds of failures, fail a connection silent for SEC seconds (default 60)"\
+                        "\n\t-b FILE       store the coprime base in FILE"\
+                        "\n\t-v            be more verbose"\
+                        "\n\t-j            use json as output format"\
+                        "\n\t-r            output the found coprimes in raw gmp format"\
+                        "\n\t-s            only check if there are coprimes"\
+                        "\n\n");
+		exit(2);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if (port > 0)
+		return serve(addr, port);
+
+	// Load, unique and sort the keys like `balanced-split`.
+	array_init(&keys, 10);
+	count = array_of_file(&keys, filename);
+	if (count == 0) {
+		fprintf(stderr, "Can't load %s\n", filename);
+		return 1;
+	}
+	if (keys.used != count) {
+		fprintf(stderr, "Array size and load count do not match\n");
+		return 2;
+	}
+	dups = array_dedup(&keys, NULL);
+	array_msort(&keys);
+
+	for (njobs = 1; level > 0 ? njobs < (1UL << (level - 1)) : njobs < 2 * nworkers; njobs *= 2);
+	if (njobs > keys.used) {
+		fprintf(stderr, "More chunks then input integers\n");
+		return 4;
+	}
+	bounds = (size_t *)malloc((njobs + 1) * sizeof(size_t));
+	chunk_bounds(bounds, njobs, wflg);
+	jobs = (cluster_job *)calloc(njobs, sizeof(cluster_job));
+	for (i = 0; i < njobs; i++) {
+		jobs[i].from = bounds[i];
+		jobs[i].to = bounds[i+1];
+	}
+	left = njobs;
+	free(bounds);
+
+	if (vflg > 0 && jflg == 0) {
+		printf("%zu unique keys (%zu duplicates), %zu chunks, %zu workers\n", keys.used, dups, njobs, nworkers);
+		if (cb_file != NULL)
+			printf("cb is going to be saved in '%s'\n", cb_file);
+		printf("Starting factorization...\n");
+	} else if (jflg > 0) {
+		printf("{\"type\":\"start\",\"msg\":\"Starting factorization\",\"count\":%zu,\"chunks\":%zu,\"workers\":%zu}\n", keys.used, njobs, nworkers);
+		fflush(stdout);
+	}
+
+	// Compute the bases of the chunks on the workers.
+	start = now();
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, dispatch, &workers[i]) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	if (left > 0) {
+		fprintf(stderr, "All workers given up, %zu chunks left\n", left);
+		return 1;
+	}
+	if (vflg > 0 && jflg == 0) {
+		printf("chunks done in %.3f s\n", now() - start);
+		for (i = 0; i < nworkers; i++)
+			printf("worker %s:%s: %zu chunks\n", workers[i].host, workers[i].port, workers[i].done);
+	}
+
+	// Merge the bases of the chunks [Algorithm 17.3](copri.html#merging-coprime-bases).
+	bases = (mpz_array *)malloc(njobs * sizeof(mpz_array));
+	for (i = 0; i < njobs; i++)
+		bases[i] = jobs[i].base;
+	array_init(&p, keys.used);
+	cbmerge_tree(&p, bases, njobs);
+	for (i = 0; i < njobs; i++)
+		array_clear(&bases[i]);
+	free(bases);
+	free(jobs);
+
+	if (cb_file != NULL) {
+		if (vflg > 0) {
+			if (jflg == 0) {
+				printf("storing cb in '%s'\n", cb_file);
+			} else {
+				printf("{\"type\":\"store\",\"msg\":\"Storing coprimebase\",\"file\":\"%s\"}\n", cb_file);
+				fflush(stdout);
+			}
+		}
+		array_to_file(&p, cb_file);
+	}
+
+	// Check if we have found more coprime bases.
+	if (p.used == keys.used) {
+		if (vflg > 0) {
+			if (jflg == 0) {
+				printf("No coprime pairs found :-(\n");
+			} else {
+				printf("{\"type\":\"info\",\"msg\":\"No coprime pairs found\"}\n");
+				fflush(stdout);
+			}
+		}
+	} else {
+		if (vflg > 0 && jflg == 0) {
+			printf("Found ~%zu coprime pairs!!!\n", p.used - keys.used);
+		}
+		if (jflg > 0) {
+			printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", p.used - keys.used);
+			fflush(stdout);
+		}
+		if (sflg == 0) {
+			// Use [Algorithm 21.2](copri.html#factoring-a-set-over-a-coprime-base) to find the coprimes in the coprime base.
+			pool_init(&pool, 0);
+			array_init(&out, 9);
+			array_find_factors(&pool, &out, &keys, &p);
+			if (out.used > 0)
+				print_factors(&out, jflg, rflg);
+			array_clear(&out);
+			pool_clear(&pool);
+		}
+	}
+
+	array_clear(&p);
+	array_clear(&keys);
+	if (jflg > 0) {
+		printf("{\"type\":\"end\",\"msg\":\"Finished\"}\n");
+		fflush(stdout);
+	}
+	return r;
+}
@@ -0,0 +1,753 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This app keeps a key corpus resident and checks new keys against it.
+//
+// The keys and the product trees of the corpus stay in memory. Clients connect
+// to a Unix domain socket (`-u PATH`) or to a TCP port on localhost
+// (`-p PORT`) and send their keys as hex lines, ended by an empty line or
+// by closing the sending side, or in the raw gmp format, ended by closing
+// the sending side. The answer uses the json format of `app -j`: every
+// new key with a shared factor and the known keys it shares the factor
+// with are printed as `Found factors`.
+//
+// The answers are buffered and written in the event loop as the client
+// reads them, so a slow reader does not stall the other clients. A client
+// which neither sends nor reads for `-t SEC` seconds is dropped.
+//
+// The requests which arrive within `-w MS` milliseconds are checked as
+// one batch. The product of the corpus is reduced once modulo the product
+// of all keys of the batch, so the pass over the product is shared by
+// all requests. The keys of a batch are added to the corpus at once, a
+// background thread builds the product tree of a new segment of the
+// corpus. Until then they are checked by the product of the pending keys.
+// A new segment absorbs the segments behind it which are not larger, like
+// a binary counter, so there are O(log n) segments and every key is part
+// of O(log n) tree builds.
+//
+// A key `k` shares a factor with the corpus if `gcd(k, prod mod k) != 1`
+// and with the other pending keys if `gcd(k, (X mod k^2) / k) != 1` for
+// the product `X` of the pending keys (including `k`). Only for a key
+// with a shared factor the other keys are searched, with `corpus_query`
+// in the trees of the segments and pairwise in the pending keys.
+//
+// With `-K FILE` the new keys are reduced against the registry of known
+// factors first (see [registry](registry.html)). The keys caught there are
+// answered with the known factor and skip the batch gcd, the factors
+// found by the batch gcd are added to the registry.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <gmp.h>
+#include "copri.h"
+#include "hash.h"
+#include "registry.h"
+#include "config.h"
+
+// The maximal count of open connections.
+#define DAEMON_MAX_CLIENTS 256
+
+// A client reads its request into `buf`, waits for the batch when it is
+// `ready` and then writes the answer in `buf` from `sent` on (`writing`).
+typedef struct {
+	int fd;
+	char *buf;
+	size_t used;
+	size_t size;
+	int ready;
+	int writing;
+	size_t sent;
+	double since;
+	double active;
+	size_t count;
+} daemon_client;
+
+// A part of the corpus with its product tree.
+typedef struct {
+	mpz_array keys;
+	copri_corpus tree;
+} daemon_segment;
+
+// The corpus in the order of arrival. The segments cover the first
+// `folded` keys.
+static mpz_hashset corpus;
+static daemon_segment *segments = NULL;
+static size_t nsegments = 0;
+static size_t folded = 0;
+
+// The background build of the segment of the keys `fold_keys` and the last
+// `fold_merge` segments.
+static mpz_array fold_keys;
+static daemon_segment fold_segment;
+static size_t fold_merge;
+static pthread_t fold_thread;
+static int fold_running = 0;
+static int wake[2];
+
+// The known factors, if `registry_file` is set.
+static copri_registry registry;
+static const char *registry_file = NULL;
+
+static volatile sig_atomic_t stop = 0;
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void on_signal(int sig) {
+	stop = 1;
+}
+
+// Builds the segment of `keys` and the segments `from..nsegments-1`.
+static void segment_build(daemon_segment *s, size_t from, mpz_array *keys) {
+	size_t i, count = keys->used;
+
+	for (i = from; i < nsegments; i++) {
+		count += segments[i].keys.used;
+	}
+	array_init(&s->keys, count + 1);
+	for (i = from; i < nsegments; i++) {
+		array_add_array(&s->keys, &segments[i].keys);
+	}
+	array_add_array(&s->keys, keys);
+	corpus_init(&s->tree, s->keys.array, s->keys.used);
+}
+
+// Replaces the segments `from..nsegments-1` by `s`.
+static void segment_replace(daemon_segment *s, size_t from) {
+	size_t i;
+
+	for (i = from; i < nsegments; i++) {
+		corpus_clear(&segments[i].tree);
+		array_clear(&segments[i].keys);
+	}
+	nsegments = from;
+	segments = (daemon_segment *)realloc(segments, (nsegments + 1) * sizeof(daemon_segment));
+	segments[nsegments++] = *s;
+}
+
+// The segments are only read while the tree is built.
+static void *fold(void *arg) {
+	segment_build(&fold_segment, nsegments - fold_merge, &fold_keys);
+	if (write(wake[1], "", 1) != 1)
+		perror("write");
+	return NULL;
+}
+
+// Starts the background build of the segment of the pending keys.
+static void fold_start() {
+	size_t i, count;
+
+	if (fold_running || folded == corpus.used)
+		return;
+	array_init(&fold_keys, corpus.used - folded);
+	for (i = folded; i < corpus.used; i++) {
+		array_add(&fold_keys, corpus.array[i]);
+	}
+	count = fold_keys.used;
+	for (fold_merge = 0; fold_merge < nsegments &&
+	segments[nsegments - fold_merge - 1].keys.used <= count; fold_merge++) {
+		count += segments[nsegments - fold_merge - 1].keys.used;
+	}
+	if (pthread_create(&fold_thread, NULL, fold, NULL) != 0) {
+		perror("pthread_create");
+		array_clear(&fold_keys);
+		return;
+	}
+	fold_running = 1;
+}
+
+// Takes the new segment after the background thread finished.
+static void fold_finish() {
+	char c;
+
+	if (read(wake[0], &c, 1) != 1 || !fold_running)
+		return;
+	pthread_join(fold_thread, NULL);
+	segment_replace(&fold_segment, nsegments - fold_merge);
+	folded += fold_keys.used;
+	array_clear(&fold_keys);
+	fold_running = 0;
+	fold_start();
+}
+
+// Returns 1 if the request of `c` is complete: the raw gmp format ends
+// with the connection, hex lines end with an empty line.
+static int complete(daemon_client *c, int eof) {
+	size_t i;
+
+	if (eof)
+		return 1;
+	if (c->used == 0 || c->buf[0] == 0)
+		return 0;
+	for (i = 0; i < c->used; i++) {
+		if (c->buf[i] == '\n' && (i == 0 || c->buf[i-1] == '\n' ||
+		(c->buf[i-1] == '\r' && (i == 1 || c->buf[i-2] == '\n'))))
+			return 1;
+	}
+	return 0;
+}
+
+// Parses the request of `c`, returns the count of invalid keys.
+static int parse(daemon_client *c, mpz_array *keys) {
+	size_t i = 0, end, size;
+	unsigned char *raw = (unsigned char *)c->buf;
+	char *line;
+	int invalid = 0;
+	mpz_t x;
+
+	mpz_init(x);
+	if (c->used > 0 && c->buf[0] == 0) {
+		while (i + 4 <= c->used) {
+			size = (size_t)raw[i] << 24 | (size_t)raw[i+1] << 16 |
+				(size_t)raw[i+2] << 8 | raw[i+3];
+			if (size > c->used - i - 4)
+				break;
+			mpz_import(x, size, 1, 1, 1, 0, raw + i + 4);
+			array_add(keys, x);
+			i += 4 + size;
+		}
+		if (i != c->used)
+			invalid++;
+	} else {
+		line = (char *)malloc(c->used + 1);
+		while (i < c->used) {
+			for (end = i; end < c->used && c->buf[end] != '\n'; end++);
+			memcpy(line, c->buf + i, end - i);
+			line[end - i] = 0;
+			if (end > i && line[end - i - 1] == '\r')
+				line[end - i - 1] = 0;
+			if (line[0] == 0)
+				break;
+			if (mpz_set_str(x, strncmp(line, "0x", 2) == 0 ? line + 2 : line, 16) == 0 &&
+			mpz_cmp_ui(x, 1) > 0)
+				array_add(keys, x);
+			else
+				invalid++;
+			i = end + 1;
+		}
+		free(line);
+	}
+	mpz_clear(x);
+	return invalid;
+}
+
+static void print_factors(FILE *out, mpz_t q, const mpz_t a, const mpz_t g) {
+	mpz_divexact(q, a, g);
+	if (registry_file != NULL) {
+		if (mpz_probab_prime_p(g, 25))
+			registry_add(&registry, g);
+		if (mpz_probab_prime_p(q, 25))
+			registry_add(&registry, q);
+	}
+	if (mpz_cmp(g, q) < 0)
+		gmp_fprintf(out, "{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", a, g, q);
+	else
+		gmp_fprintf(out, "{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", a, q, g);
+}
+
+// Prints the factors of `a` and `b` if they share a factor and returns 1
+// if the factors of `a` were printed, now or before (`reported`).
+static int print_pair(FILE *out, mpz_t q, mpz_t g, const mpz_t a, const mpz_t b,
+int reported) {
+	if (mpz_cmp(a, b) == 0)
+		return reported;
+	mpz_gcd(g, a, b);
+	if (mpz_cmp_ui(g, 1) == 0)
+		return reported;
+	if (!reported && mpz_cmp(g, a) != 0) {
+		print_factors(out, q, a, g);
+		reported = 1;
+	}
+	if (mpz_cmp(g, b) != 0)
+		print_factors(out, q, b, g);
+	return reported;
+}
+
+// Checks the keys of all ready clients as one batch and puts their
+// answers into their buffers.
+static void batch(mpz_pool *pool, daemon_client *clients, size_t count,
+const char *append, int vflg) {
+	mpz_array keys, added, pending, known, rest, *checked = &added;
+	mpz_t q, q2, r, rx, x, g, h;
+	size_t i, j, k, l, m, n = 0, hits = 0, *from, *found, nfound = 64;
+	daemon_segment *seg;
+	char *fresh;
+	int *invalid, reported;
+	double start = now();
+	FILE *out;
+	char *text;
+	size_t size;
+
+	// Parse the requests and add the new keys to the corpus. The new keys
+	// of the client `i` are `added[from[i]..from[i+1]-1]`.
+	from = (size_t *)malloc((count + 1) * sizeof(size_t));
+	invalid = (int *)malloc(count * sizeof(int));
+	array_init(&added, 16);
+	for (i = 0; i < count; i++) {
+		from[i] = added.used;
+		array_init(&keys, 16);
+		invalid[i] = parse(&clients[i], &keys);
+		for (j = 0; j < keys.used; j++) {
+			if (hashset_insert(&corpus, keys.array[j]))
+				array_add(&added, keys.array[j]);
+		}
+		n += keys.used;
+		clients[i].count = keys.used;
+		array_clear(&keys);
+	}
+	from[count] = added.used;
+	fresh = (char *)calloc(added.used + 1, 1);
+
+	mpz_init(q);
+	mpz_init(q2);
+	mpz_init(r);
+	mpz_init(rx);
+	mpz_init(x);
+	mpz_init(g);
+	mpz_init(h);
+	found = (size_t *)malloc(nfound * sizeof(size_t));
+
+	// The keys with a known factor skip the batch gcd, they are marked
+	// with 2.
+	array_init(&known, 9);
+	array_init(&rest, added.used + 1);
+	if (registry_file != NULL && added.used > 0) {
+		registry_filter(pool, &registry, &known, &rest, &added);
+		for (k = 0; k < added.used; k++) {
+			for (l = 0; l < known.used; l += 3) {
+				if (mpz_cmp(known.array[l], added.array[k]) == 0)
+					fresh[k] = 2;
+			}
+		}
+		checked = &rest;
+	}
+
+	if (checked->used > 0) {
+		// One pass over the products of the segments for the whole batch.
+		array_prod(pool, checked, q);
+		for (l = 0; l < nsegments; l++) {
+			corpus_mod(r, &segments[l].tree, q);
+			for (k = 0; k < added.used; k++) {
+				if (fresh[k])
+					continue;
+				mpz_fdiv_r(x, r, added.array[k]);
+				mpz_gcd(x, x, added.array[k]);
+				if (mpz_cmp_ui(x, 1) != 0)
+					fresh[k] = 1;
+			}
+		}
+
+		// The pending keys include the batch.
+		pending.array = corpus.array + folded;
+		pending.used = pending.size = corpus.used - folded;
+		array_prod(pool, &pending, x);
+		mpz_mul(q2, q, q);
+		mpz_fdiv_r(rx, x, q2);
+
+		for (k = 0; k < added.used; k++) {
+			if (!fresh[k]) {
+				mpz_mul(h, added.array[k], added.array[k]);
+				mpz_fdiv_r(x, rx, h);
+				mpz_divexact(x, x, added.array[k]);
+				mpz_gcd(x, x, added.array[k]);
+				if (mpz_cmp_ui(x, 1) != 0)
+					fresh[k] = 1;
+			}
+		}
+	}
+	for (k = 0; k < added.used; k++) {
+		if (fresh[k])
+			hits++;
+	}
+
+	// Answer every client with the factors of its keys.
+	for (i = 0; i < count; i++) {
+		text = NULL;
+		out = open_memstream(&text, &size);
+		if (out == NULL) {
+			perror("open_memstream");
+			exit(1);
+		}
+		fprintf(out, "{\"type\":\"start\",\"msg\":\"Checking keys\",\"count\":%zu}\n", clients[i].count);
+		if (invalid[i] > 0)
+			fprintf(out, "{\"type\":\"info\",\"msg\":\"Invalid keys skipped\",\"count\":%d}\n", invalid[i]);
+		if (clients[i].count > from[i+1] - from[i])
+			fprintf(out, "{\"type\":\"info\",\"msg\":\"Known keys skipped\",\"count\":%zu}\n", clients[i].count - (from[i+1] - from[i]));
+		for (j = from[i]; j < from[i+1]; j++) {
+			if (!fresh[j])
+				continue;
+			if (fresh[j] == 2) {
+				for (l = 0; l < known.used; l += 3) {
+					if (mpz_cmp(known.array[l], added.array[j]) == 0)
+						print_factors(out, q, added.array[j], known.array[l+1]);
+				}
+				continue;
+			}
+			// Search the keys which share a factor with this key in the
+			// trees of the segments and in the pending keys, the key itself
+			// is printed once.
+			reported = 0;
+			for (l = 0; l < nsegments; l++) {
+				seg = &segments[l];
+				m = corpus_query(&seg->tree, found, nfound, added.array[j]);
+				if (m > nfound) {
+					nfound = m;
+					found = (size_t *)realloc(found, nfound * sizeof(size_t));
+					corpus_query(&seg->tree, found, nfound, added.array[j]);
+				}
+				for (k = 0; k < m; k++) {
+					reported = print_pair(out, q, g, added.array[j], seg->keys.array[found[k]], reported);
+				}
+			}
+			for (k = folded; k < corpus.used; k++) {
+				reported = print_pair(out, q, g, added.array[j], corpus.array[k], reported);
+			}
+		}
+		fprintf(out, "{\"type\":\"end\",\"msg\":\"Finished\",\"corpus\":%zu}\n", corpus.used);
+		fclose(out);
+		free(clients[i].buf);
+		clients[i].buf = text;
+		clients[i].used = clients[i].size = size;
+		clients[i].sent = 0;
+		clients[i].ready = 0;
+		clients[i].writing = 1;
+		clients[i].active = now();
+	}
+
+	if (append != NULL && added.used > 0 && array_to_file(&added, append) != added.used)
+		fprintf(stderr, "Can't append the new keys to %s\n", append);
+	if (registry_file != NULL)
+		registry_to_file(&registry, registry_file);
+	if (vflg > 0) {
+		printf("batch of %zu keys from %zu requests, %zu new, %zu with shared factors, %.3f s\n",
+			n, count, added.used, hits, now() - start);
+		fflush(stdout);
+	}
+
+	free(from);
+	free(invalid);
+	free(fresh);
+	free(found);
+	array_clear(&known);
+	array_clear(&rest);
+	array_clear(&added);
+	mpz_clear(q);
+	mpz_clear(q2);
+	mpz_clear(r);
+	mpz_clear(rx);
+	mpz_clear(x);
+	mpz_clear(g);
+	mpz_clear(h);
+
+	fold_start();
+}
+
+static int listen_unix(const char *path) {
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0 || strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int listen_tcp(int port) {
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	daemon_client clients[DAEMON_MAX_CLIENTS], ready[DAEMON_MAX_CLIENTS];
+	struct pollfd fds[DAEMON_MAX_CLIENTS + 3];
+	mpz_array view;
+	mpz_pool pool;
+	size_t used = 0, i, nready;
+	ssize_t len;
+	long int port = 0, window = 20, idle = 30;
+	double first, deadline;
+	int c, fd, timeout, done, listeners = 0, vflg = 0, errflg = 0;
+	char *filename = NULL, *socket_path = NULL, *append = NULL;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":vu:p:w:t:a:K:")) != -1) {
+		switch(c) {
+		case 'u':
+			socket_path = optarg;
+			break;
+		case 'p':
+			port = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			idle = strtol(optarg, NULL, 0);
+			break;
+		case 'a':
+			append = optarg;
+			break;
+		case 'K':
+			registry_file = optarg;
+			break;
+		case 'v':
+			vflg++;
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (optind < argc) {
+		filename = argv[optind];
+		if (optind + 1 < argc) errflg++;
+	}
+
+	if ((socket_path == NULL && port == 0) || port < 0 || port > 65535 || window < 0 || idle <= 0)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-v] [-u PATH] [-p PORT] [-w MS] [-t SEC] [-a FILE] [-K FILE] [file]\n"\
+                        "\n\t-u PATH   listen on the Unix domain socket PATH"\
+                        "\n\t-p PORT   listen on the TCP port PORT of localhost"\
+                        "\n\t-w MS     check the requests of MS milliseconds as one batch (default 20)"\
+                        "\n\t-t SEC    drop clients which are idle for SEC seconds (default 30)"\
+                        "\n\t-a FILE   append the new keys to FILE"\
+                        "\n\t-K FILE   check the keys against the known factors in FILE first, add the found factors to FILE"\
+                        "\n\t-v        be more verbose"\
+                        "\n\n");
+		exit(2);
+	}
+
+	// Load the corpus and build its product tree.
+	hashset_init(&corpus, 0);
+	if (filename != NULL && hashset_of_file(&corpus, filename) == HASHSET_NO_FILE) {
+		fprintf(stderr, "Can't load %s\n", filename);
+		return 1;
+	}
+	pool_init(&pool, 0);
+	view.array = corpus.array;
+	view.used = view.size = corpus.used;
+	if (view.used > 0) {
+		segment_build(&fold_segment, 0, &view);
+		segment_replace(&fold_segment, 0);
+	}
+	folded = corpus.used;
+
+	if (registry_file != NULL) {
+		registry_init(&registry);
+		registry_of_file(&registry, registry_file);
+	}
+
+	// Open the sockets.
+	if (pipe(wake) != 0) {
+		perror("pipe");
+		return 1;
+	}
+	fds[listeners].fd = wake[0];
+	fds[listeners++].events = POLLIN;
+	if (socket_path != NULL) {
+		if ((fds[listeners].fd = listen_unix(socket_path)) < 0) {
+			fprintf(stderr, "Can't listen on %s\n", socket_path);
+			return 1;
+		}
+		fds[listeners++].events = POLLIN;
+	}
+	if (port > 0) {
+		if ((fds[listeners].fd = listen_tcp(port)) < 0) {
+			fprintf(stderr, "Can't listen on port %ld\n", port);
+			return 1;
+		}
+		fds[listeners++].events = POLLIN;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (vflg > 0) {
+		printf("%zu keys loaded, waiting for requests\n", corpus.used);
+		fflush(stdout);
+	}
+
+	while (!stop) {
+		// Wait for the batch window of the oldest complete request or the
+		// first idle client.
+		first = 0;
+		deadline = 0;
+		for (i = 0; i < used; i++) {
+			if (clients[i].ready && (first == 0 || clients[i].since < first))
+				first = clients[i].since;
+			if (!clients[i].ready && (deadline == 0 || clients[i].active + idle < deadline))
+				deadline = clients[i].active + idle;
+		}
+		if (first > 0 && (deadline == 0 || first + window / 1000.0 < deadline))
+			deadline = first + window / 1000.0;
+		timeout = -1;
+		if (deadline > 0) {
+			timeout = (int)((deadline - now()) * 1000) + 1;
+			if (timeout < 0)
+				timeout = 0;
+		}
+		for (i = 0; i < used; i++) {
+			fds[listeners + i].fd = clients[i].ready ? -1 : clients[i].fd;
+			fds[listeners + i].events = clients[i].writing ? POLLOUT : POLLIN;
+		}
+		if (poll(fds, listeners + used, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		if (fds[0].revents & POLLIN)
+			fold_finish();
+		for (i = 1; i < listeners; i++) {
+			if (!(fds[i].revents & POLLIN) || used == DAEMON_MAX_CLIENTS)
+				continue;
+			fd = accept(fds[i].fd, NULL, NULL);
+			if (fd < 0)
+				continue;
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			memset(&clients[used], 0, sizeof(daemon_client));
+			clients[used].fd = fd;
+			clients[used].size = 4096;
+			clients[used].buf = (char *)malloc(clients[used].size);
+			clients[used].active = now();
+			used++;
+		}
+
+		// Read the requests and write the answers. The clients which are
+		// done, failed or idle for too long are closed.
+		for (i = 0; i < used; i++) {
+			if (clients[i].ready)
+				continue;
+			done = 0;
+			if (clients[i].writing && (fds[listeners + i].revents & (POLLOUT | POLLERR | POLLHUP))) {
+				len = write(clients[i].fd, clients[i].buf + clients[i].sent, clients[i].used - clients[i].sent);
+				if (len > 0) {
+					clients[i].sent += len;
+					clients[i].active = now();
+				}
+				if ((len < 0 && errno != EAGAIN && errno != EINTR) || clients[i].sent == clients[i].used)
+					done = 1;
+			} else if (!clients[i].writing && (fds[listeners + i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				if (clients[i].used == clients[i].size) {
+					clients[i].size *= 2;
+					clients[i].buf = (char *)realloc(clients[i].buf, clients[i].size);
+				}
+				len = read(clients[i].fd, clients[i].buf + clients[i].used, clients[i].size - clients[i].used);
+				if (len < 0 && (errno == EAGAIN || errno == EINTR))
+					continue;
+				if (len > 0) {
+					clients[i].used += len;
+					clients[i].active = now();
+				}
+				if (complete(&clients[i], len <= 0)) {
+					clients[i].ready = 1;
+					clients[i].since = now();
+				}
+			}
+			if (!clients[i].ready && (done || clients[i].active + idle <= now())) {
+				if (vflg > 0 && !done) {
+					printf("dropped a client idle for %ld s\n", idle);
+					fflush(stdout);
+				}
+				close(clients[i].fd);
+				free(clients[i].buf);
+				clients[i].fd = -1;
+			}
+		}
+		for (i = 0, nready = 0; i < used; i++) {
+			if (clients[i].fd >= 0)
+				clients[nready++] = clients[i];
+		}
+		used = nready;
+
+		// Check the batch if the window of the oldest request is over.
+		nready = 0;
+		for (i = 0; i < used; i++) {
+			if (clients[i].ready && clients[i].since + window / 1000.0 <= now() + 1e-3)
+				nready = 1;
+		}
+		if (nready == 0)
+			continue;
+		nready = 0;
+		for (i = 0; i < used; i++) {
+			if (clients[i].ready)
+				ready[nready++] = clients[i];
+		}
+		batch(&pool, ready, nready, append, vflg);
+		for (i = 0, nready = 0; i < used; i++) {
+			if (clients[i].ready)
+				clients[i] = ready[nready++];
+		}
+	}
+
+	if (fold_running) {
+		pthread_join(fold_thread, NULL);
+		segment_replace(&fold_segment, nsegments);
+		array_clear(&fold_keys);
+	}
+	if (socket_path != NULL)
+		unlink(socket_path);
+	for (i = 0; i < used; i++) {
+		close(clients[i].fd);
+		free(clients[i].buf);
+	}
+	hashset_clear(&corpus);
+	if (registry_file != NULL)
+		registry_clear(&registry);
+	for (i = 0; i < nsegments; i++) {
+		corpus_clear(&segments[i].tree);
+		array_clear(&segments[i].keys);
+	}
+	free(segments);
+	pool_clear(&pool);
+	return 0;
+}
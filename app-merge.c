@@ -5,6 +5,15 @@
 
 // This file contains a simple application of the
 // [copri](copri.html) library.
+//
+// Two or more coprime bases are merged by `cbmerge` and the elements of
+// all files are factored over the merged base. With `-x` the files are two key sets
+// which are coprime on their own, e.g. an already checked corpus and a new
+// batch, and only the pairs of a key of each set with a common factor are
+// searched by `cross_factors`. No base is built in this mode, the product
+// tree of the first set reduces the keys of the second set. Every pair is
+// printed with both keys and their gcd, so the key of the first set which
+// matched is known.
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -12,22 +21,59 @@
 #include "copri.h"
 #include "config.h"
 
+// Prints the triples (key, p, q) of `out`.
+static void print_factors(mpz_array *out, int jflg, int rflg) {
+	size_t i;
+
+	if ((out->used % 3) != 0) {
+		fprintf(stderr, "Find factors returned an invalid array\n");
+	} else if (jflg > 0) {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out->array[i], out->array[i+1], out->array[i+2]);
+		fflush(stdout);
+	} else if (rflg > 0) {
+		for(i = 0; i < out->used; i++)
+			mpz_out_raw(stdout, out->array[i]);
+	} else {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out->array[i], out->array[i+1], out->array[i+2]);
+	}
+}
+
+// Prints the triples (key of the first set, key of the second set, gcd) of
+// `out`.
+static void print_pairs(mpz_array *out, int jflg, int rflg) {
+	size_t i;
+
+	if (jflg > 0) {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("{\"type\":\"result\",\"msg\":\"Found common factor\",\"a\":\"%Zu\",\"b\":\"%Zu\",\"gcd\":\"%Zu\"}\n", out->array[i], out->array[i+1], out->array[i+2]);
+		fflush(stdout);
+	} else if (rflg > 0) {
+		for(i = 0; i < out->used; i++)
+			mpz_out_raw(stdout, out->array[i]);
+	} else {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("Found coprime ----\n%Zu\nand\n%Zu\nshare\n%Zu\n----\n", out->array[i], out->array[i+1], out->array[i+2]);
+	}
+}
+
 // The generic `main` function.
 //
 // Define all variables at the beginning to make the C99 compiler
 // happy.
 int main(int argc, char **argv) {
-	mpz_array s1, s2, p, out;
+	mpz_array *s, p, out;
 	mpz_pool pool;
-	size_t c1, c2, i;
-	int c, vflg = 0, sflg = 0, rflg = 0, jflg = 0, errflg = 0, r = 0;
-	char *file1 = "primes1.lst";
-	char *file2 = "primes2.lst";
+	size_t count, total = 0, files = 2, i;
+	int c, vflg = 0, sflg = 0, rflg = 0, jflg = 0, xflg = 0, errflg = 0, r = 0;
+	char *defaults[] = { "primes1.lst", "primes2.lst" };
+	char **names = defaults;
 	char *cb_file = NULL;
 
 	// #### argument parsing
 	// Boring `getopt` argument parsing.
-	while ((c = getopt(argc, argv, ":svrjb:")) != -1) {
+	while ((c = getopt(argc, argv, ":svrjxb:")) != -1) {
 		switch(c) {
 		case 'b':
 			cb_file = optarg;
@@ -44,6 +90,9 @@ int main(int argc, char **argv) {
 		case 'j':
 			jflg++;
 			break;
+		case 'x':
+			xflg++;
+			break;
 		case ':':
 			fprintf(stderr, "Option -%c requires an operand\n", optopt);
 			errflg++;
@@ -55,9 +104,9 @@ int main(int argc, char **argv) {
 	}
 
 	if (optind < argc) {
-		file1 = argv[optind];
-		file2 = argv[optind+1];
-		if (optind + 2 < argc) errflg++;
+		names = argv + optind;
+		files = argc - optind;
+		if (files < 2) errflg++;
 	}
 
 	if (rflg && vflg) {
@@ -65,10 +114,21 @@ int main(int argc, char **argv) {
 		errflg++;
 	}
 
+	if (xflg && cb_file != NULL) {
+		fprintf(stderr, "\n\t-x doesn't build a coprime base to store with -b!\n\n");
+		errflg++;
+	}
+
+	if (xflg && files != 2) {
+		fprintf(stderr, "\n\t-x needs exactly two files!\n\n");
+		errflg++;
+	}
+
 	// Print the usage and exit if an error occurred during argument parsing.
 	if (errflg) {
-		fprintf(stderr, "usage: [-vsr] [-b out-file] [cb-file1] [cb-file1]\n"\
+		fprintf(stderr, "usage: [-vsrjx] [-b out-file] [cb-file1] [cb-file2] [cb-file...]\n"\
                         "\n\t-b FILE   store the coprime base in FILE"\
+                        "\n\t-x        only search common factors of keys across the two files"\
                         "\n\t-v        be more verbose"\
 						"\n\t-j        use json as output format"\
                         "\n\t-r        output the found coprimes in raw gmp format"\
@@ -85,108 +145,123 @@ int main(int argc, char **argv) {
 	}
 
 	// Load the keys.
-	array_init(&s1, 10);
-	c1 = array_of_file(&s1, file1);
-	array_init(&s2, 10);
-	c2 = array_of_file(&s2, file2);
-
-	pool_init(&pool, c1);
-	if (c1 == 0) {
-		fprintf(stderr, "Can't load %s\n", file1);
-		return 1;
-	}
-	if (c2 == 0) {
-		fprintf(stderr, "Can't load %s\n", file2);
-		return 1;
-	}
-	if (s1.used != c1 ||  s2.used != c2) {
-		fprintf(stderr, "Array size and load count do not match\n");
-		return 2;
+	s = (mpz_array *)malloc(files * sizeof(mpz_array));
+	for (i = 0; i < files; i++) {
+		array_init(&s[i], 10);
+		count = array_of_file(&s[i], names[i]);
+		if (count == 0) {
+			fprintf(stderr, "Can't load %s\n", names[i]);
+			return 1;
+		}
+		if (s[i].used != count) {
+			fprintf(stderr, "Array size and load count do not match\n");
+			return 2;
+		}
+		total += count;
 	}
+	pool_init(&pool, s[0].used);
+
 	// Print the key count.
 	if (vflg > 0 && jflg == 0) {
-		printf("coprime base 1 size: %zu\ncoprime base 2 size: %zu\n", s1.used, s2.used);
+		for (i = 0; i < files; i++)
+			printf("%s %zu size: %zu\n", xflg ? "key set" : "coprime base", i + 1, s[i].used);
 		if (cb_file != NULL)
 			printf("cb is going to be saved in '%s'\n", cb_file);
 		printf("Starting factorization...\n");
 	} else if (jflg > 0) {
-		printf("{\"type\":\"start\",\"msg\":\"Starting factorization\",\"count\":[%zu,%zu]}\n", s1.used, s2.used);
+		printf("{\"type\":\"start\",\"msg\":\"Starting factorization\",\"count\":[");
+		for (i = 0; i < files; i++)
+			printf(i ? ",%zu" : "%zu", s[i].used);
+		printf("]}\n");
 		fflush(stdout);
 	}
 
-	// Computing a coprime base for a finite set [Algorithm 18.1](copri.html#computing-a-coprime-base-for-a-finite-set).
-	array_init(&p, s1.used+s2.used);
-	cbmerge(&pool, &p, &s1, &s2);
-
-	if (cb_file != NULL) {
-		if (vflg > 0) {
-			if (jflg == 0) {
-				printf("storing cb in '%s'\n", cb_file);
-			} else {
-				printf("{\"type\":\"store\",\"msg\":\"Storing coprimebase\",\"file\":\"%s\"}\n", cb_file);
-				fflush(stdout);
+	// Only the pairs across the two key sets, see
+	// [Scanning two corpora](copri.html#scanning-two-corpora).
+	if (xflg > 0) {
+		array_init(&out, 9);
+		cross_factors(&pool, &out, &s[0], &s[1]);
+		if (out.used == 0) {
+			if (vflg > 0) {
+				if (jflg == 0) {
+					printf("No coprime pairs found :-(\n");
+				} else {
+					printf("{\"type\":\"info\",\"msg\":\"No coprime pairs found\"}\n");
+					fflush(stdout);
+				}
 			}
-		}
-		array_to_file(&p, cb_file);
-	}
-
-
-	// Check if we have found more coprime bases.
-	if (p.used == s1.used + s2.used) {
-		if (vflg > 0) {
-			if (jflg == 0) {
-				printf("No coprime pairs found :-(\n");
-			} else {
-				printf("{\"type\":\"info\",\"msg\":\"No coprime pairs found\"}\n");
+		} else {
+			if (vflg > 0 && jflg == 0)
+				printf("Found %zu pairs across the sets!!!\n", out.used / 3);
+			if (jflg > 0) {
+				printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", out.used / 3);
 				fflush(stdout);
 			}
+			if (sflg == 0)
+				print_pairs(&out, jflg, rflg);
 		}
-		r = 0;
+		array_clear(&out);
 	} else {
-		if (vflg > 0 && jflg == 0) {
-			printf("Found ~%zu coprime pairs!!!\n", (p.used - (s1.used + s2.used)));
-		}
-		if (jflg > 0) {
-			printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", (p.used - (s1.used + s2.used)));
-			fflush(stdout);
-		}
-		if (sflg == 0) {
+		// Merging the coprime bases [Algorithm 17.3](copri.html#merging-coprime-bases).
+		array_init(&p, total);
+		cbmerge_tree(&p, s, files);
+
+		if (cb_file != NULL) {
 			if (vflg > 0) {
 				if (jflg == 0) {
-					printf("Searching factors...\n");
+					printf("storing cb in '%s'\n", cb_file);
 				} else {
-					printf("{\"type\":\"info\",\"msg\":\"Searching factors\"}\n");
+					printf("{\"type\":\"store\",\"msg\":\"Storing coprimebase\",\"file\":\"%s\"}\n", cb_file);
 					fflush(stdout);
 				}
 			}
-			array_init(&out, 9);
-			// Use [Algorithm 21.2](copri.html#factoring-a-set-over-a-coprime-base) to find the coprimes in the coprime base.
-			array_find_factors(&pool, &out, &s1, &p);
-			array_find_factors(&pool, &out, &s2, &p);
-			// Output the factors.
-			if (out.used > 0) {
-				if ((out.used % 3) != 0) {
-					fprintf(stderr, "Find factors returned an invalid array\n");
+			array_to_file(&p, cb_file);
+		}
+
+		// Check if we have found more coprime bases.
+		if (p.used == total) {
+			if (vflg > 0) {
+				if (jflg == 0) {
+					printf("No coprime pairs found :-(\n");
 				} else {
-					if (jflg > 0) {
-						for(i = 0; i < out.used; i+=3)
-							gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out.array[i], out.array[i+1], out.array[i+2]);
-					} else if (rflg > 0) {
-						for(i = 0; i < out.used; i++)
-							mpz_out_raw(stdout, out.array[i]);
+					printf("{\"type\":\"info\",\"msg\":\"No coprime pairs found\"}\n");
+					fflush(stdout);
+				}
+			}
+			r = 0;
+		} else {
+			if (vflg > 0 && jflg == 0) {
+				printf("Found ~%zu coprime pairs!!!\n", (p.used - total));
+			}
+			if (jflg > 0) {
+				printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", (p.used - total));
+				fflush(stdout);
+			}
+			if (sflg == 0) {
+				if (vflg > 0) {
+					if (jflg == 0) {
+						printf("Searching factors...\n");
 					} else {
-						for(i = 0; i < out.used; i+=3)
-							gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out.array[i], out.array[i+1], out.array[i+2]);
+						printf("{\"type\":\"info\",\"msg\":\"Searching factors\"}\n");
+						fflush(stdout);
 					}
 				}
+				array_init(&out, 9);
+				// Use [Algorithm 21.2](copri.html#factoring-a-set-over-a-coprime-base) to find the coprimes in the coprime base.
+				for (i = 0; i < files; i++)
+					array_find_factors(&pool, &out, &s[i], &p);
+				// Output the factors.
+				if (out.used > 0)
+					print_factors(&out, jflg, rflg);
+				array_clear(&out);
 			}
-			array_clear(&out);
 		}
-	}
 
-	array_clear(&p);
-	array_clear(&s1);
-	array_clear(&s2);
+		array_clear(&p);
+	}
+	for (i = 0; i < files; i++)
+		array_clear(&s[i]);
+	free(s);
 	if (vflg > 0 && jflg == 0)
 		pool_inspect(&pool);
 	pool_clear(&pool);
@@ -4,25 +4,103 @@
 // See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
 
 // This app implements a n^2 test application.
+//
+// The gcd of every pair of keys is computed. The triangle of all pairs
+// is split into tiles of `t` by `t` keys and the tiles are distributed
+// over the threads.
+//
+// Almost all pairs are coprime, so a key is first tested against the
+// product of all keys of the other block with a single gcd (the product
+// is reduced modulo the key first). Only if this gcd is not 1 the key is
+// compared with every key of the block. In a tile on the diagonal every
+// key is tested against the product of the keys before it.
+//
+// If all keys have 1024, 2048 or 4096 bit, the block tests and the tests
+// of two keys use the fixed width gcd of [fixed](fixed.html). The tiles
+// are then small enough for the block products to fit into its buffer.
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <time.h>
 #include <gmp.h>
 #include "copri.h"
+#include "fixed.h"
+#include "config.h"
+#if USE_OPENMP
+#include <omp.h>
+#endif
+
+// The size of the block products in bytes.
+#define N2_BLOCK_SIZE (FIXED_MAX_DIVIDEND * sizeof(mp_limb_t))
+
+// The count of tests used for the time estimate.
+#define N2_SAMPLE_TESTS 100
+
+typedef struct {
+	size_t i;
+	size_t j;
+} n2_pair;
 
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int n2_pair_cmp(const void *a, const void *b) {
+	const n2_pair *x = (const n2_pair *)a, *y = (const n2_pair *)b;
+	if (x->i != y->i) return x->i < y->i ? -1 : 1;
+	if (x->j != y->j) return x->j < y->j ? -1 : 1;
+	return 0;
+}
+
+static void n2_gcd(const fixed_kernel *k, mpz_t g, const mpz_t a, const mpz_t b) {
+	if (k != NULL) {
+		k->gcd(g, a, b);
+	} else {
+		mpz_gcd(g, a, b);
+	}
+}
+
+// Prints `a` = `g` x `a / g` in the format of `app -j`, the smaller
+// factor first.
+static void n2_print_json(mpz_t q, const mpz_t a, const mpz_t g) {
+	mpz_fdiv_q(q, a, g);
+	if (mpz_cmp(g, q) < 0)
+		gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", a, g, q);
+	else
+		gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", a, q, g);
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
 int main(int argc, char **argv) {
 	mpz_array s;
-	mpz_t g;
-	size_t count, i, j;
+	mpz_t g, q;
+	mpz_t *products;
+	size_t count, i, j, tile = 0, blocks, tiles, t, bi, bj, samples, bytes = 0, end;
+	size_t found_used = 0, found_size = 16, threads = 1;
+	n2_pair *found;
+	char *reported;
+	const fixed_kernel *k;
+	double start, estimate;
 
-	int c, vflg = 0, errflg = 0;
+	int c, vflg = 0, jflg = 0, errflg = 0;
 	char *filename = "primes.lst";
 
-	while ((c = getopt(argc, argv, ":sv")) != -1) {
+	while ((c = getopt(argc, argv, ":svjt:")) != -1) {
 		switch(c) {
 		case 'v':
 			vflg++;
 			break;
+		case 'j':
+			jflg++;
+			break;
+		case 't':
+			tile = strtol(optarg, NULL, 0);
+			break;
 		case ':':
 			fprintf(stderr, "Option -%c requires an operand\n", optopt);
 			errflg++;
@@ -38,16 +116,18 @@ int main(int argc, char **argv) {
 		if (optind + 1 < argc) errflg++;
 	}
 
-	// Print the usage and exit if an error occurred during argument parsing.
 	if (errflg) {
-		fprintf(stderr, "usage: [-v] [file]\n"\
+		fprintf(stderr, "usage: [-vj] [-t TILE] [file]\n"\
 						"\n\t-v        be more verbose"\
+						"\n\t-j        use json as output format"\
+						"\n\t-t TILE   the count of keys per tile side"\
 						"\n\n");
 		exit(2);
 	}
 
 	array_init(&s, 10);
 	mpz_init(g);
+	mpz_init(q);
 
 	count = array_of_file(&s, filename);
 	if (count == 0) {
@@ -62,23 +142,163 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "No primes loaded (empty file)");
 		return 3;
 	}
-	if (vflg > 0) {
-		printf("Loaded %zu primes\nStarting factorization...\n", s.used);
+
+	// Use the fixed width gcd if all keys have 1024, 2048 or 4096 bit.
+	k = fixed_kernel_for(fixed_width(&s));
+
+	// The product of a block has about `N2_BLOCK_SIZE` bytes.
+	if (tile == 0) {
+		for (i = 0; i < s.used; i++) {
+			bytes += mpz_size(s.array[i]) * sizeof(mp_limb_t);
+		}
+		tile = N2_BLOCK_SIZE / (bytes / s.used + 1);
+		if (tile < 16) tile = 16;
 	}
+	if (k != NULL && tile * k->limbs > FIXED_MAX_DIVIDEND)
+		tile = FIXED_MAX_DIVIDEND / k->limbs;
+	blocks = (s.used + tile - 1) / tile;
+	tiles = blocks * (blocks + 1) / 2;
 
-	for(i = 0; i < s.used; i++) {
-		for(j = 0; j < s.used; j++) {
-			if (j > i) {
-				mpz_gcd(g, s.array[i], s.array[j]);
-				if (mpz_cmp_ui(g, 1) != 0) {
-					gmp_printf("Found coprime ----\n%Zu\nand\n%Zu\nshare\n%Zu\n----\n", s.array[i], s.array[j], g);
+	products = (mpz_t *)malloc(blocks * sizeof(mpz_t));
+#if USE_OPENMP
+#pragma omp parallel for private(i, end)
+#endif
+	for (t = 0; t < blocks; t++) {
+		mpz_init_set_ui(products[t], 1);
+		end = (t + 1) * tile < s.used ? (t + 1) * tile : s.used;
+		for (i = t * tile; i < end; i++) {
+			mpz_mul(products[t], products[t], s.array[i]);
+		}
+	}
+#if USE_OPENMP
+	threads = omp_get_max_threads();
+#endif
+
+	// Estimate the time by a sample of key against block tests. Every key
+	// is tested against about half of the blocks.
+	samples = s.used < N2_SAMPLE_TESTS ? s.used : N2_SAMPLE_TESTS;
+	start = now();
+	for (t = 0; t < samples; t++) {
+		n2_gcd(k, g, s.array[t * 7919 % s.used], products[t % blocks]);
+	}
+	estimate = (now() - start) / samples * s.used * (blocks + 1) / 2 / threads;
+
+	if (jflg > 0) {
+		printf("{\"type\":\"start\",\"msg\":\"Starting factorization\",\"count\":%zu}\n", s.used);
+		if (vflg > 0)
+			printf("{\"type\":\"info\",\"msg\":\"Estimated time\",\"seconds\":%.1f,\"threads\":%zu}\n", estimate, threads);
+		fflush(stdout);
+	} else if (vflg > 0) {
+		printf("Loaded %zu primes\n", s.used);
+		if (k != NULL)
+			printf("Using the %zu bit kernel\n", k->bits);
+		printf("%zu tiles of %zu keys on %zu threads\n", tiles, tile, threads);
+		printf("Estimated time: %.1f s\n", estimate);
+		printf("Starting factorization...\n");
+	}
+
+	found = (n2_pair *)malloc(found_size * sizeof(n2_pair));
+
+	// The tile `t` is the pair of blocks (bi, bj) with bi <= bj, the tiles
+	// are counted row by row.
+#if USE_OPENMP
+#pragma omp parallel private(t, bi, bj, i, j)
+#endif
+{
+	mpz_t h, prefix;
+	mpz_init(h);
+	mpz_init(prefix);
+#if USE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+	for (t = 0; t < tiles; t++) {
+		bi = 0;
+		bj = t;
+		while (bj >= blocks - bi) {
+			bj -= blocks - bi;
+			bi++;
+		}
+		bj += bi;
+
+		mpz_set_ui(prefix, 1);
+		for (i = bi * tile; i < (bi + 1) * tile && i < s.used; i++) {
+			// Test the key against the other block or the keys before it
+			// in the same block.
+			if (bi == bj) {
+				n2_gcd(k, h, s.array[i], prefix);
+				mpz_mul(prefix, prefix, s.array[i]);
+			} else {
+				n2_gcd(k, h, s.array[i], products[bj]);
+			}
+			if (mpz_cmp_ui(h, 1) == 0)
+				continue;
+
+			for (j = bj * tile; j < (bj + 1) * tile && j < s.used; j++) {
+				if (bi == bj && j >= i)
+					break;
+				n2_gcd(k, h, s.array[i], s.array[j]);
+				if (mpz_cmp_ui(h, 1) != 0) {
+#if USE_OPENMP
+#pragma omp critical
+#endif
+{
+					if (found_used == found_size) {
+						found_size *= 2;
+						found = (n2_pair *)realloc(found, found_size * sizeof(n2_pair));
+					}
+					found[found_used].i = j < i ? j : i;
+					found[found_used].j = j < i ? i : j;
+					found_used++;
+}
 				}
 			}
 		}
 	}
+	mpz_clear(h);
+	mpz_clear(prefix);
+}
 
+	// Print the pairs in the order of the keys.
+	qsort(found, found_used, sizeof(n2_pair), n2_pair_cmp);
+	reported = (char *)calloc(s.used, 1);
+	if (jflg > 0 && found_used > 0) {
+		printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", found_used);
+	}
+	for (t = 0; t < found_used; t++) {
+		i = found[t].i;
+		j = found[t].j;
+		n2_gcd(k, g, s.array[i], s.array[j]);
+		if (jflg == 0) {
+			gmp_printf("Found coprime ----\n%Zu\nand\n%Zu\nshare\n%Zu\n----\n", s.array[i], s.array[j], g);
+			continue;
+		}
+		// Like `app` every key is reported once, duplicates are skipped.
+		if (!reported[i] && mpz_cmp(g, s.array[i]) != 0) {
+			n2_print_json(q, s.array[i], g);
+			reported[i] = 1;
+		}
+		if (!reported[j] && mpz_cmp(g, s.array[j]) != 0) {
+			n2_print_json(q, s.array[j], g);
+			reported[j] = 1;
+		}
+	}
+
+	if (jflg > 0) {
+		printf("{\"type\":\"end\",\"msg\":\"Finished\"}\n");
+		fflush(stdout);
+	} else if (vflg > 0) {
+		printf("Found %zu pairs in %.1f s\n", found_used, now() - start);
+	}
+
+	for (t = 0; t < blocks; t++) {
+		mpz_clear(products[t]);
+	}
+	free(products);
+	free(found);
+	free(reported);
 	array_clear(&s);
 	mpz_clear(g);
+	mpz_clear(q);
 
 	return 0;
 }
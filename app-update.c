@@ -0,0 +1,284 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This app adds new keys to a stored coprime base.
+//
+// The coprime base of a corpus (`app -b FILE`) is loaded and the new keys
+// are added with `cbupdate`, the whole corpus is not needed. The updated
+// base replaces the base file. The new keys are factored over the updated
+// base. With `-k` the old keys which are divisible by a base element that
+// was split by the new keys are factored too, all other old keys have
+// the same factors as before. With `-K` the new keys with a known factor
+// are factored by the registry and left out of the base, the factors
+// found are added to the registry.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "copri.h"
+#include "hash.h"
+#include "registry.h"
+#include "config.h"
+
+// Replaces `filename` by the integers of `a`.
+static int store(mpz_array *a, const char *filename) {
+	char *tmp = (char *)malloc(strlen(filename) + 5);
+	int ok;
+
+	sprintf(tmp, "%s.tmp", filename);
+	unlink(tmp);
+	ok = array_to_file(a, tmp) == a->used && rename(tmp, filename) == 0;
+	if (!ok)
+		unlink(tmp);
+	free(tmp);
+	return ok;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array p, q, s, keys, changed, affected, out, known, rest, factors, gc, gk;
+	mpz_hashset h;
+	mpz_pool pool;
+	copri_registry registry;
+	copri_corpus c_changed, c_factors;
+	mpz_t y;
+	size_t dups, i, n, caught = 0;
+	int c, vflg = 0, rflg = 0, jflg = 0, errflg = 0;
+	char *cb_file = NULL;
+	char *filename = NULL;
+	char *keys_file = NULL;
+	char *registry_file = NULL;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":vrjk:K:")) != -1) {
+		switch(c) {
+		case 'k':
+			keys_file = optarg;
+			break;
+		case 'K':
+			registry_file = optarg;
+			break;
+		case 'v':
+			vflg++;
+			break;
+		case 'r':
+			rflg++;
+			break;
+		case 'j':
+			jflg++;
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (optind + 2 == argc) {
+		cb_file = argv[optind];
+		filename = argv[optind+1];
+	} else {
+		errflg++;
+	}
+
+	if (rflg && vflg) {
+		fprintf(stderr, "\n\t-r and -v can't be used simultaneously!\n\n");
+		errflg++;
+	}
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-vrj] [-k FILE] [-K FILE] cb-file new-keys-file\n"\
+                        "\n\t-k FILE   the old keys, factor the ones affected by the new keys"\
+                        "\n\t-K FILE   factor the new keys with a known factor in FILE first, add the found factors to FILE"\
+                        "\n\t-v        be more verbose"\
+						"\n\t-j        use json as output format"\
+                        "\n\t-r        output the found coprimes in raw gmp format"\
+                        "\n\n");
+		exit(2);
+	}
+
+	// Load the base and the keys.
+	array_init(&p, 10);
+	array_init(&s, 10);
+	array_init(&keys, 10);
+	if (array_of_file(&p, cb_file) == 0) {
+		fprintf(stderr, "Can't load %s\n", cb_file);
+		return 1;
+	}
+	if (array_of_file(&s, filename) == 0) {
+		fprintf(stderr, "Can't load %s\n", filename);
+		return 1;
+	}
+	if (keys_file != NULL && array_of_file(&keys, keys_file) == 0) {
+		fprintf(stderr, "Can't load %s\n", keys_file);
+		return 1;
+	}
+	pool_init(&pool, s.used);
+
+	// Remove duplicate keys, so `cbupdate` only sees distinct integers.
+	dups = array_dedup(&s, NULL);
+
+	// The keys with a known factor are not added to the base.
+	array_init(&known, 9);
+	if (registry_file != NULL) {
+		registry_init(&registry);
+		registry_of_file(&registry, registry_file);
+		array_init(&rest, s.used);
+		caught = registry_filter(&pool, &registry, &known, &rest, &s);
+		array_clear(&s);
+		s = rest;
+	}
+
+	if (vflg > 0 && jflg == 0) {
+		printf("coprime base size: %zu\n%zu new keys loaded\n", p.used, s.used);
+		if (dups > 0)
+			printf("%zu duplicate keys removed\n", dups);
+		if (registry_file != NULL)
+			printf("%zu keys with known factors\n", caught);
+		printf("Updating the coprime base...\n");
+	} else if (jflg > 0) {
+		printf("{\"type\":\"start\",\"msg\":\"Updating coprimebase\",\"count\":[%zu,%zu]}\n", p.used, s.used);
+		fflush(stdout);
+	}
+
+	// Compute cb(P ∪ S) and find the elements of P which were split.
+	array_init(&q, p.used + s.used);
+	cbupdate(&pool, &q, &p, &s);
+
+	hashset_init(&h, q.used);
+	hashset_add_array(&h, &q);
+	array_init(&changed, 10);
+	for (i = 0; i < p.used; i++) {
+		if (!hashset_contains(&h, p.array[i]))
+			array_add(&changed, p.array[i]);
+	}
+	hashset_clear(&h);
+
+	if (vflg > 0) {
+		if (jflg == 0) {
+			printf("%zu base elements split, %zu new elements\n", changed.used, q.used + changed.used - p.used);
+			printf("storing cb in '%s'\n", cb_file);
+		} else {
+			printf("{\"type\":\"info\",\"msg\":\"Updated coprimebase\",\"split\":%zu,\"count\":%zu}\n", changed.used, q.used);
+			printf("{\"type\":\"store\",\"msg\":\"Storing coprimebase\",\"file\":\"%s\"}\n", cb_file);
+			fflush(stdout);
+		}
+	}
+	if (!store(&q, cb_file)) {
+		fprintf(stderr, "Can't store %s\n", cb_file);
+		return 1;
+	}
+
+	// The new keys and the old keys with a factor in a split element are
+	// factored again. The old keys which share a factor with a caught key
+	// are factored by this factor, the caught keys are not in the base.
+	// Both kinds of old keys are found by remainder trees (`corpus_gcds`)
+	// of the split elements and of the known factors. Every key is
+	// factored once: a key already queued, e.g. a new key which is an old
+	// key too, is skipped.
+	array_init(&affected, s.used + 1);
+	array_add_array(&affected, &s);
+	if (keys.used > 0 && (changed.used > 0 || known.used > 0)) {
+		hashset_init(&h, 0);
+		hashset_add_array(&h, &s);
+		for (i = 0; i < known.used; i += 3) {
+			hashset_insert(&h, known.array[i]);
+		}
+		array_init(&factors, known.used + 1);
+		for (i = 0; i < known.used; i += 3) {
+			array_add(&factors, known.array[i+1]);
+			array_add(&factors, known.array[i+2]);
+		}
+		array_init(&gc, keys.used);
+		array_init(&gk, keys.used);
+		corpus_init(&c_changed, changed.array, changed.used);
+		corpus_gcds(&pool, &gc, &c_changed, &keys);
+		corpus_clear(&c_changed);
+		corpus_init(&c_factors, factors.array, factors.used);
+		corpus_gcds(&pool, &gk, &c_factors, &keys);
+		corpus_clear(&c_factors);
+
+		mpz_init(y);
+		n = known.used;
+		for (i = 0; i < keys.used; i++) {
+			if (mpz_cmp_ui(gk.array[i], 1) != 0 && mpz_cmp(gk.array[i], keys.array[i]) != 0) {
+				if (!hashset_insert(&h, keys.array[i]))
+					continue;
+				mpz_divexact(y, keys.array[i], gk.array[i]);
+				array_add(&known, keys.array[i]);
+				array_add(&known, gk.array[i]);
+				array_add(&known, y);
+			} else if (mpz_cmp_ui(gc.array[i], 1) != 0 && hashset_insert(&h, keys.array[i])) {
+				array_add(&affected, keys.array[i]);
+			}
+		}
+		if (vflg > 0 && jflg == 0 && known.used > n)
+			printf("%zu old keys share a known factor\n", (known.used - n) / 3);
+		mpz_clear(y);
+		array_clear(&gc);
+		array_clear(&gk);
+		array_clear(&factors);
+		hashset_clear(&h);
+	}
+	if (vflg > 0 && jflg == 0) {
+		printf("Searching factors of %zu keys...\n", affected.used);
+	}
+
+	array_init(&out, 9);
+	array_add_array(&out, &known);
+	// Use [Algorithm 21.2](copri.html#factoring-a-set-over-a-coprime-base) to find the coprimes in the coprime base.
+	if (affected.used > 0)
+		array_find_factors(&pool, &out, &affected, &q);
+
+	if (registry_file != NULL) {
+		registry_add_factors(&registry, &out);
+		registry_to_file(&registry, registry_file);
+		registry_clear(&registry);
+	}
+
+	// Output the factors.
+	if (out.used > 0) {
+		if ((out.used % 3) != 0) {
+			fprintf(stderr, "Find factors returned an invalid array\n");
+		} else {
+			if (jflg > 0) {
+				for(i = 0; i < out.used; i+=3)
+					gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out.array[i], out.array[i+1], out.array[i+2]);
+			} else if (rflg > 0) {
+				for(i = 0; i < out.used; i++)
+					mpz_out_raw(stdout, out.array[i]);
+			} else {
+				for(i = 0; i < out.used; i+=3)
+					gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out.array[i], out.array[i+1], out.array[i+2]);
+			}
+		}
+	}
+
+	array_clear(&out);
+	array_clear(&known);
+	array_clear(&affected);
+	array_clear(&changed);
+	array_clear(&q);
+	array_clear(&p);
+	array_clear(&s);
+	array_clear(&keys);
+	if (vflg > 0 && jflg == 0)
+		pool_inspect(&pool);
+	pool_clear(&pool);
+	if (jflg > 0) {
+		printf("{\"type\":\"end\",\"msg\":\"Finished\"}\n");
+		fflush(stdout);
+	}
+	return 0;
+}
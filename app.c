@@ -8,8 +8,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <gmp.h>
 #include "copri.h"
+#include "hash.h"
+#include "registry.h"
 #include "config.h"
 
 // Start by defining an neat looking banner.
@@ -31,21 +34,48 @@
 "        Algorithm by Daniel J. Bernstein           \n"\
 "   http://cr.yp.to/lineartime/dcba-20040404.pdf    \n\n");
 
+// Prints the triples (key, p, q) of `out`.
+static void print_factors(mpz_array *out, int jflg, int rflg) {
+	size_t i;
+
+	if ((out->used % 3) != 0) {
+		fprintf(stderr, "Find factors returned an invalid array\n");
+	} else if (jflg > 0) {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out->array[i], out->array[i+1], out->array[i+2]);
+		fflush(stdout);
+	} else if (rflg > 0) {
+		for(i = 0; i < out->used; i++)
+			mpz_out_raw(stdout, out->array[i]);
+	} else {
+		for(i = 0; i < out->used; i+=3)
+			gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out->array[i], out->array[i+1], out->array[i+2]);
+	}
+}
+
 // The generic `main` function.
 //
 // Define all variables at the beginning to make the C99 compiler
 // happy.
 int main(int argc, char **argv) {
-	mpz_array s, p, out;
+	mpz_array s, p, out, known, rest;
 	mpz_pool pool;
-	size_t count, i;
+	copri_registry registry;
+	size_t count, dups, caught = 0;
 	int c, vflg = 0, sflg = 0, rflg = 0, errflg = 0, jflg = 0, r = 0;
 	char *filename = "primes.lst";
 	char *cb_file = NULL;
+	char *registry_file = NULL;
+	char *checkpoint_dir = NULL;
+	double interval = 300;
+	static struct option long_options[] = {
+		{"resume", no_argument, NULL, 'R'},
+		{NULL, 0, NULL, 0}
+	};
 
 	// #### argument parsing
 	// Boring `getopt` argument parsing.
-	while ((c = getopt(argc, argv, ":svrjb:")) != -1) {
+	while ((c = getopt_long(argc, argv, ":svrjwb:l:k:m:d:c:i:K:", long_options, NULL)) != -1) {
 		switch(c) {
 		case 'b':
 			cb_file = optarg;
@@ -62,6 +92,33 @@ int main(int argc, char **argv) {
 		case 'j':
 			jflg++;
 			break;
+		case 'w':
+			copri_set_split(COPRI_SPLIT_BITS);
+			break;
+		case 'l':
+			copri_set_leaf(strtol(optarg, NULL, 0));
+			break;
+		case 'k':
+			copri_set_tree_step(strtol(optarg, NULL, 0));
+			break;
+		case 'm':
+			copri_set_tree_memory(strtol(optarg, NULL, 0) * 1048576);
+			break;
+		case 'd':
+			copri_set_tree_dir(optarg);
+			break;
+		case 'c':
+			checkpoint_dir = optarg;
+			break;
+		case 'i':
+			interval = strtod(optarg, NULL);
+			break;
+		case 'R':
+			copri_set_resume(1);
+			break;
+		case 'K':
+			registry_file = optarg;
+			break;
 		case ':':
 			fprintf(stderr, "Option -%c requires an operand\n", optopt);
 			errflg++;
@@ -77,6 +134,12 @@ int main(int argc, char **argv) {
 		if (optind + 1 < argc) errflg++;
 	}
 
+	if (copri_get_resume() && checkpoint_dir == NULL) {
+		fprintf(stderr, "\n\t--resume needs a checkpoint directory (-c DIR)!\n\n");
+		errflg++;
+	}
+	copri_set_checkpoint(checkpoint_dir, interval);
+
 	if (rflg && vflg) {
 		fprintf(stderr, "\n\t-r and -v can't be used simultaneously!\n\n");
 		errflg++;
@@ -84,8 +147,17 @@ int main(int argc, char **argv) {
 
 	// Print the usage and exit if an error occurred during argument parsing.
 	if (errflg) {
-		fprintf(stderr, "usage: [-vsr] [file]\n"\
+		fprintf(stderr, "usage: [-vsrw] [-b FILE] [-l LEAF] [-k STEP] [-m MB] [-d DIR] [-c DIR [-i SEC] [--resume]] [-K FILE] [file]\n"\
                         "\n\t-b FILE   store the coprime base in FILE"\
+                        "\n\t-w        split the product trees by bit length"\
+                        "\n\t-l LEAF   handle subsets up to LEAF keys directly (see calibrate)"\
+                        "\n\t-k STEP   keep every STEP-th level of the product trees"\
+                        "\n\t-m MB     keep as many product tree levels as fit into MB"\
+                        "\n\t-d DIR    keep the product tree levels of trees above MB (default 64) in DIR"\
+                        "\n\t-c DIR    store checkpoints of the coprime base computation in DIR"\
+                        "\n\t-i SEC    take a checkpoint every SEC seconds (default 300)"\
+                        "\n\t--resume  continue from the checkpoints in DIR"\
+                        "\n\t-K FILE   factor the keys with a known factor in FILE first, add the found factors to FILE"\
                         "\n\t-v        be more verbose"\
 						"\n\t-j        use json as output format"\
                         "\n\t-r        output the found coprimes in raw gmp format"\
@@ -126,21 +198,63 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "No primes loaded (empty file)\n");
 		return 3;
 	}
+
+	// Remove duplicate keys, so `cb` only sees distinct integers.
+	dups = array_dedup(&s, NULL);
+	if (dups > 0 && vflg > 0) {
+		if (jflg == 0) {
+			printf("%zu duplicate keys removed\n", dups);
+		} else {
+			printf("{\"type\":\"info\",\"msg\":\"Removed duplicate keys\",\"count\":%zu}\n", dups);
+			fflush(stdout);
+		}
+	}
+
+	// The keys with a known factor are factored by a remainder tree of the
+	// registry, only the other keys go on to the coprime base.
+	if (registry_file != NULL) {
+		registry_init(&registry);
+		registry_of_file(&registry, registry_file);
+		array_init(&known, 9);
+		array_init(&rest, s.used);
+		caught = registry_filter(&pool, &registry, &known, &rest, &s);
+		if (vflg > 0) {
+			if (jflg == 0) {
+				printf("%zu keys with known factors (%zu known factors)\n", caught, registry.primes.used);
+			} else {
+				printf("{\"type\":\"info\",\"msg\":\"Found keys with known factors\",\"count\":%zu}\n", caught);
+				fflush(stdout);
+			}
+		}
+		array_clear(&s);
+		s = rest;
+	}
+
 	// Print the key count.
 	if (vflg > 0 && jflg == 0) {
 		printf("%zu public keys loaded\n", s.used);
 		if (cb_file != NULL)
 			printf("cb is going to be saved in '%s'\n", cb_file);
+		if (checkpoint_dir != NULL)
+			printf("%s checkpoints in '%s'\n", copri_get_resume() ? "Resuming from" : "Storing", checkpoint_dir);
 		printf("Starting factorization...\n");
 	} else if (jflg > 0) {
 		printf("{\"type\":\"start\",\"msg\":\"Starting factorization\",\"count\":%zu}\n", s.used);
 		fflush(stdout);
 	}
 
+	// Output the factors of the keys with a known factor.
+	if (registry_file != NULL) {
+		if (sflg == 0)
+			print_factors(&known, jflg, rflg);
+		array_clear(&known);
+	}
+
 
 	// Computing a coprime base for a finite set [Algorithm 18.1](copri.html#computing-a-coprime-base-for-a-finite-set).
-	array_init(&p, s.used);
-	array_cb(&pool, &p, &s);
+	array_init(&p, s.used + 1);
+	if (s.used > 0)
+		array_cb(&pool, &p, &s);
 
 	if (cb_file != NULL) {
 		if (vflg > 0) {
@@ -156,8 +270,9 @@ int main(int argc, char **argv) {
 	}
 
 
-	// Check if we have found more coprime bases.
-	if (p.used == s.used) {
+	// Check if we have found more coprime bases or keys with a known
+	// factor.
+	if (p.used == s.used && caught == 0) {
 		if (vflg > 0) {
 			if (jflg == 0) {
 				printf("No coprime pairs found :-(\n");
@@ -169,14 +284,14 @@ int main(int argc, char **argv) {
 		r = 0;
 	} else {
 		if (vflg > 0 && jflg == 0) {
-			printf("Found ~%zu coprime pairs!!!\n", (p.used - s.used));
+			printf("Found ~%zu coprime pairs!!!\n", (p.used - s.used) + caught);
 		}
 		if (jflg > 0) {
-			printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", (p.used - s.used));
+			printf("{\"type\":\"interim result\",\"msg\":\"Found coprime pairs\",\"count\":%zu}\n", (p.used - s.used) + caught);
 			fflush(stdout);
 		}
 
-		if (sflg == 0) {
+		if (sflg == 0 && p.used != s.used) {
 			if (vflg > 0) {
 				if (jflg == 0) {
 					printf("Searching factors...\n");
@@ -190,26 +305,20 @@ int main(int argc, char **argv) {
 			array_find_factors(&pool, &out, &s, &p);
 
 			// Output the factors.
-			if (out.used > 0) {
-				if ((out.used % 3) != 0) {
-					fprintf(stderr, "Find factors returned an invalid array\n");
-				} else {
-					if (jflg > 0) {
-						for(i = 0; i < out.used; i+=3)
-							gmp_printf("{\"type\":\"result\",\"msg\":\"Found factors\",\"key\":\"%Zu\",\"p\":\"%Zu\",\"q\":\"%Zu\"}\n", out.array[i], out.array[i+1], out.array[i+2]);
-					} else if (rflg > 0) {
-						for(i = 0; i < out.used; i++)
-							mpz_out_raw(stdout, out.array[i]);
-					} else {
-						for(i = 0; i < out.used; i+=3)
-							gmp_printf("\n### Found factors of\n%Zu\n=\n%Zu\nx\n%Zu\n", out.array[i], out.array[i+1], out.array[i+2]);
-					}
-				}
-			}
+			if (out.used > 0)
+				print_factors(&out, jflg, rflg);
+			if (registry_file != NULL)
+				registry_add_factors(&registry, &out);
 			array_clear(&out);
 		}
 	}
 
+	// Store the new factors.
+	if (registry_file != NULL) {
+		registry_to_file(&registry, registry_file);
+		registry_clear(&registry);
+	}
+
 	array_clear(&p);
 	array_clear(&s);
 	if (vflg > 0 && jflg == 0)
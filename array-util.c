@@ -6,36 +6,116 @@
 // This file contains a array util application
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <gmp.h>
 #include "copri.h"
+#include "hash.h"
+#include "extsort.h"
+
+// ## Streaming input
+
+// All filters work element by element, so the integers are streamed
+// from the input files to the output. Only sorting (`-s`, `-u`) requires
+// the whole input, it is done either in memory or on disk (`-m`) before
+// the stream starts.
+typedef struct {
+	const char **filenames;
+	size_t count;
+	size_t next;
+	FILE *in;
+	mpz_array *array;
+	size_t pos;
+} int_source;
+
+// Reads the next integer of the source into `x`.
+// Returns `1` on success, `0` at the end of the input and `-1` if an
+// input file can not be opened.
+static int source_next(int_source *src, mpz_t x) {
+	if (src->array != NULL) {
+		if (src->pos >= src->array->used) return 0;
+		mpz_set(x, src->array->array[src->pos++]);
+		return 1;
+	}
+	while (1) {
+		if (src->in == NULL) {
+			if (src->next >= src->count) return 0;
+			if (strcmp(src->filenames[src->next], "-") == 0) {
+				src->in = stdin;
+			} else {
+				src->in = fopen(src->filenames[src->next], "r");
+				if (src->in == NULL) {
+					fprintf(stderr, "Can't load %s\n", src->filenames[src->next]);
+					return -1;
+				}
+			}
+			src->next++;
+		}
+		if (mpz_inp_raw(x, src->in) > 0) return 1;
+		if (src->in != stdin)
+			fclose(src->in);
+		src->in = NULL;
+	}
+}
+
+// Streams the integers of the files.
+static void source_of_files(int_source *src, const char **filenames, size_t count) {
+	src->filenames = filenames;
+	src->count = count;
+	src->next = 0;
+	src->in = NULL;
+	src->array = NULL;
+	src->pos = 0;
+}
+
+// Streams the integers of an array.
+static void source_of_array(int_source *src, mpz_array *a) {
+	source_of_files(src, NULL, 0);
+	src->array = a;
+}
+
+static void source_close(int_source *src) {
+	if (src->in != NULL && src->in != stdin)
+		fclose(src->in);
+	src->in = NULL;
+}
 
 // The generic `main` function.
 //
 // Define all variables at the beginning to make the C99 compiler
 // happy.
 int main(int argc, char **argv) {
-	mpz_array s, uniques, filtered, seekedLength, sample;
-	mpz_t sum_bits, avg;
-	size_t count, i, j, size, size_min = 0, size_max = 0;
-	int c, vflg = 0, iflg = 0, sflg = 0, lflg = 0, bflg = 0, rflg = 0, uflg = 0, tflg = 0, xflg = 0, jflg = 0, errflg = 0, r = 0;
-	char *filename = "primes.lst";
+	mpz_array s, sample;
+	mpz_t x, last, prev, sum_bits, avg;
+	size_t count = 0, read_count = 0, unique_count = 0, written = 0, i, size, size_min = 0, size_max = 0;
+	int c, vflg = 0, iflg = 0, sflg = 0, lflg = 0, bflg = 0, rflg = 0, uflg = 0, tflg = 0, xflg = 0, jflg = 0, dflg = 0, mflg = 0, errflg = 0, r = 0;
+	const char **filenames = NULL;
+	size_t filename_count = 0;
 	char *out_filename = NULL;
+	char *exclude_filename = NULL;
+	char *keep_filename = NULL;
+	mpz_hashset exclude, keep;
 	long int length = 0;
 	long int seek = 0;
 	long int tolerance = 0;
 	long int bitsize = 0;
+	// for the external sort
+	long int memory = 0;
+	extsort_stats stats;
+	FILE *sorted = NULL;
+	// for the stream
+	int_source src;
+	FILE *out = NULL;
+	size_t position = 0, emitted = 0;
+	int has_last = 0, has_prev = 0;
 	// for random sampling
 	long int sample_size = 0;
 	gmp_randstate_t randstate;
-	mpz_t r_index;
-	mpz_t r_max;
-	size_t *used_indices;
-	int found = 0;
+	unsigned long pick;
 
 	// #### argument parsing
 	// Boring `getopt` argument parsing.
-	while ((c = getopt(argc, argv, ":vsiujr:x:t:b:l:o:")) != -1) {
+	while ((c = getopt(argc, argv, ":vsiujdm:e:k:r:x:t:b:l:o:")) != -1) {
 		switch(c) {
 		case 'o':
 			out_filename = optarg;
@@ -55,6 +135,19 @@ int main(int argc, char **argv) {
 		case 'j':
 			jflg++;
 			break;
+		case 'd':
+			dflg++;
+			break;
+		case 'e':
+			exclude_filename = optarg;
+			break;
+		case 'k':
+			keep_filename = optarg;
+			break;
+		case 'm':
+			mflg++;
+			memory = strtol(optarg, NULL, 0);
+			break;
 		case 'r':
 			rflg++;
 			sample_size = strtol(optarg, NULL, 0);
@@ -85,8 +178,9 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	if (optind == argc - 1) {
-		filename = argv[optind];
+	if (optind < argc) {
+		filenames = (const char **)(argv + optind);
+		filename_count = argc - optind;
 	} else {
 		errflg++;
 	}
@@ -96,9 +190,20 @@ int main(int argc, char **argv) {
 		errflg++;
 	}
 
+	if (mflg > 0) {
+		if (memory <= 0) {
+			fprintf(stderr, "\n\t-m requires a memory budget > 0 MB!\n\n");
+			errflg++;
+		}
+		if (sflg == 0 && uflg == 0 && dflg == 0) {
+			fprintf(stderr, "\n\t-m requires -s, -u or -d!\n\n");
+			errflg++;
+		}
+	}
+
 	// Print the usage and exit if an error occurred during argument parsing.
 	if (errflg) {
-		fprintf(stderr, "usage: [-vs] [-o FILE] [file]\n"\
+		fprintf(stderr, "usage: [-vsud] [-m MB] [-o FILE] [file...]\n"\
 						"\n\t-i        inspect the array"\
 						"\n\t-o FILE   the output file"\
 						"\n\t-l length max values to output or chunk size"\
@@ -107,9 +212,13 @@ int main(int argc, char **argv) {
 						"\n\t-v        be more verbose"\
 						"\n\t-s        sort the input"\
 						"\n\t-u        count uniques"\
+						"\n\t-d        remove duplicates (of sorted input, with -m of any input)"\
+						"\n\t-m MB     sort on disk with a memory budget of MB"\
 						"\n\t-j        print json array"\
 						"\n\t-x bits   only output integers with size bits"\
 						"\n\t-t bits   tolerance in bits for -x"\
+						"\n\t-e FILE   exclude the integers listed in FILE"\
+						"\n\t-k FILE   keep only the integers listed in FILE"\
 						"\n\n");
 		exit(2);
 	}
@@ -119,175 +228,273 @@ int main(int argc, char **argv) {
 		iflg++;
 	}
 
-	// Load the integers.
-	array_init(&s, 10);
-	count = array_of_file(&s, filename);
-	if (count == 0) {
-		fprintf(stderr, "Can't load %s\n", filename);
-		return 1;
-	}
-	if (s.used != count) {
-		fprintf(stderr, "Array size and load count do not match\n");
-		return 2;
-	}
-	if (s.used == 0) {
-		fprintf(stderr, "No integers loaded (empty file)\n");
-		return 3;
+	if (rflg > 0 && sample_size <= 0) {
+		fprintf(stderr, "Sample size is %ld\n", sample_size);
+		return 6;
 	}
 
-	if (out_filename != NULL && vflg > 0 && !jflg) {
-		printf("output is going to be saved in '%s'\n", out_filename);
-	}
+	mpz_init(x);
+	mpz_init(last);
+	mpz_init(prev);
+	mpz_init_set_ui(sum_bits, 0);
 
 	// # preprocessing functions
 
-	if (sflg > 0 || uflg > 0) {
-		if (vflg > 0)
-			printf("sorting the input integers...\n");
-		array_msort(&s);
+	// Sorting needs the whole input, sort it on disk or in memory and
+	// stream the sorted integers. Duplicates of unsorted input are only
+	// removed by the external sort, a set of the seen integers would grow
+	// with the input.
+	if (sflg > 0 || uflg > 0 || (dflg > 0 && mflg > 0)) {
+		if (mflg > 0) {
+			if (vflg > 0)
+				printf("sorting the input integers with a memory budget of %ld MB...\n", memory);
+			sorted = extsort_tmpfile(NULL);
+			if (sorted == NULL) {
+				fprintf(stderr, "Can't create a temporary file\n");
+				return 1;
+			}
+			r = extsort(sorted, filenames, filename_count,
+				memory * 1024 * 1024, dflg, NULL, &stats);
+			if (r != 0) {
+				return r;
+			}
+			if (vflg > 0)
+				printf("merged %zu sorted runs\n", stats.runs);
+			rewind(sorted);
+			source_of_files(&src, NULL, 0);
+			src.in = sorted;
+		} else {
+			array_init(&s, 10);
+			for (i = 0; i < filename_count; i++) {
+				if (array_of_file(&s, filenames[i]) == 0 &&
+				strcmp(filenames[i], "-") != 0 && access(filenames[i], R_OK) != 0) {
+					fprintf(stderr, "Can't load %s\n", filenames[i]);
+					return 1;
+				}
+			}
+			if (dflg > 0) {
+				if (vflg > 0)
+					printf("removing duplicate integers...\n");
+				count = array_dedup(&s, NULL);
+				if (vflg > 0)
+					printf("removed %zu duplicates\n", count);
+			}
+			if (vflg > 0)
+				printf("sorting the input integers...\n");
+			array_msort(&s);
+			source_of_array(&src, &s);
+		}
+	} else {
+		source_of_files(&src, filenames, filename_count);
 	}
 
-	// # filter functions
-
-	// filter per bit size
-	if (xflg > 0) {
-		if (vflg > 0) {
-			printf("filter %zu integers by size %zu bits +/- %zu bits\n", s.used, bitsize, tolerance);
+	// Load the exclude (blacklist) and keep (whitelist) files.
+	if (exclude_filename != NULL) {
+		hashset_init(&exclude, 0);
+		if (hashset_of_file(&exclude, exclude_filename) == HASHSET_NO_FILE) {
+			fprintf(stderr, "Can't load %s\n", exclude_filename);
+			return 1;
+		}
+	}
+	if (keep_filename != NULL) {
+		hashset_init(&keep, 0);
+		if (hashset_of_file(&keep, keep_filename) == HASHSET_NO_FILE) {
+			fprintf(stderr, "Can't load %s\n", keep_filename);
+			return 1;
 		}
-		array_init(&filtered, 10);
-		for(i=0; i<s.used; i++) {
-			size = mpz_sizeinbase(s.array[i], 2);
-			if (size <= (bitsize + tolerance) && size >= (bitsize - tolerance)) {
-				array_add(&filtered, s.array[i]);
+	}
+
+	if (out_filename != NULL) {
+		if (vflg > 0 && !jflg)
+			printf("output is going to be saved in '%s'\n", out_filename);
+		if (strcmp(out_filename, "-") == 0) {
+			out = stdout;
+		} else {
+			out = fopen(out_filename, "a+");
+			if (out == NULL) {
+				fprintf(stderr, "Can't open %s\n", out_filename);
+				return 4;
 			}
 		}
-		array_clear(&s);
-		s = filtered;
 	}
 
-	// create random sample
+	if (vflg > 0) {
+		if (xflg > 0)
+			printf("filter integers by size %ld bits +/- %ld bits\n", bitsize, tolerance);
+		if (rflg > 0)
+			printf("creating random sample of %ld integers\n", sample_size);
+		if (lflg || bflg)
+			printf("seeking to %ld and limiting to %ld integers\n", seek, length);
+	}
+
 	if (rflg > 0) {
-		if (s.used < sample_size) {
-			fprintf(stderr, "Sample size %zu is bigger then input size %zu\n", sample_size, s.used);
-			return 6;
-		}
-		if (sample_size <= 0) {
-			fprintf(stderr, "Sample size is %zu\n", sample_size);
-			return 6;
-		}
-		if (vflg > 0) {
-			printf("creating random sample of %zu from %zu integers\n", sample_size, s.used);
-		}
 		gmp_randinit_default(randstate);
-		mpz_init_set_ui(r_max, s.used);
-		mpz_init(r_index);
-		array_init(&sample, 10);
-		used_indices = (size_t *)malloc(sample_size * sizeof(size_t));
-		while(sample.used < sample_size) {
-			mpz_urandomm(r_index, randstate, r_max);
-			i = mpz_get_ui(r_index);
-			found = 0;
-			for (j=0; j<sample.used; j++) {
-				if (used_indices[j] == i) {
-					found = 1;
-					break;
+		array_init(&sample, sample_size);
+	}
+
+	if (jflg > 0) {
+		printf("[");
+	}
+
+	// # filter functions
+
+	// The filters are applied to every integer of the stream. Without
+	// a random sample the stream stops as soon as the limit is reached.
+	while (1) {
+		r = source_next(&src, x);
+		if (r < 0) return 1;
+		if (r == 0) {
+			// Stream the finished random sample.
+			if (rflg > 0 && src.array != &sample) {
+				if (count < sample_size) {
+					fprintf(stderr, "Sample size %ld is bigger then input size %zu\n", sample_size, count);
+					return 6;
 				}
+				if (vflg > 0)
+					printf("picked %zu of %zu random integers\n", sample.used, count);
+				source_close(&src);
+				source_of_array(&src, &sample);
+				continue;
 			}
-			if (!found) {
-				used_indices[sample.used] = i;
-				array_add(&sample, s.array[i]);
-				if (vflg > 0 && (sample.used % (sample_size / 10) == 0 || sample.used == sample_size)) {
-					printf("picked %zu of %zu random integers\n", sample.used, sample_size);
+			break;
+		}
+		r = 0;
+
+		if (src.array != &sample) {
+			read_count++;
+
+			// filter duplicates of a sorted stream
+			if (dflg > 0 && sflg == 0 && uflg == 0 && mflg == 0) {
+				if (has_prev && mpz_cmp(x, prev) < 0) {
+					fprintf(stderr, "The input is not sorted, use -d with -s or -m MB\n");
+					return 7;
 				}
+				if (has_prev && mpz_cmp(x, prev) == 0)
+					continue;
+				has_prev = 1;
+				mpz_set(prev, x);
 			}
-		}
-		free(used_indices);
-		gmp_randclear(randstate);
-		mpz_clear(r_index);
-		mpz_clear(r_max);
-		array_clear(&s);
-		s = sample;
-	}
 
-	// filter per seek and length
-	if (lflg || bflg) {
-		if (vflg > 0) {
-			printf("seeking to %zu and limiting to %zu integers\n", seek, length);
-		}
-		array_init(&seekedLength, 10);
-		j = 0;
-		for(i=seek; i<s.used; i++) {
-			if (lflg) {
-				if (j >= length) break;
-				j++;
+			// filter per exclude (blacklist) and keep (whitelist) files
+			if (exclude_filename != NULL && hashset_contains(&exclude, x))
+				continue;
+			if (keep_filename != NULL && !hashset_contains(&keep, x))
+				continue;
+
+			// filter per bit size
+			if (xflg > 0) {
+				size = mpz_sizeinbase(x, 2);
+				if (size > (bitsize + tolerance) || size < (bitsize - tolerance))
+					continue;
+			}
+
+			// create random sample, reservoir sampling keeps a uniform
+			// sample of the integers seen so far
+			if (rflg > 0) {
+				if (count < sample_size) {
+					array_add(&sample, x);
+				} else {
+					pick = gmp_urandomm_ui(randstate, count + 1);
+					if (pick < sample_size)
+						mpz_set(sample.array[pick], x);
+				}
+				count++;
+				continue;
 			}
-			array_add(&seekedLength, s.array[i]);
 		}
-		array_clear(&s);
-		s = seekedLength;
-	}
 
-	// # Output functions
+		// filter per seek and length
+		if (position++ < seek)
+			continue;
+		if (lflg && emitted >= length)
+			break;
+		emitted++;
+
+		// # Output functions
 
-	// print info
-	if (iflg > 0) {
-		printf("count: %zu\n", s.used);
-		mpz_init_set_ui(sum_bits, 0);
-		for(i=0; i<s.used; i++) {
-			size = mpz_sizeinbase(s.array[i], 2);
-			mpz_add_ui(sum_bits, sum_bits, size);
-			if (size_min == 0 || size_min > size)
-				size_min = size;
-			if (size_max == 0 || size_max < size)
-				size_max = size;
+		// collect the info
+		size = mpz_sizeinbase(x, 2);
+		mpz_add_ui(sum_bits, sum_bits, size);
+		if (size_min == 0 || size_min > size)
+			size_min = size;
+		if (size_max == 0 || size_max < size)
+			size_max = size;
 
+		// count uniques of the sorted stream
+		if (!has_last || mpz_cmp(last, x) != 0) {
+			unique_count++;
+			has_last = 1;
+			mpz_set(last, x);
 		}
-		mpz_init(avg);
-		mpz_cdiv_q_ui(avg, sum_bits, s.used);
 
-		if (size_min == size_max) {
-			printf("size (all): %zu bit\n", size_min);
-		} else {
-			gmp_printf("size:\n  - min: %zu bit\n  - max: %zu bit\n  - avg: %Zu bit\n", size_min, size_max, avg);
+		// print JSON
+		if (jflg > 0) {
+			gmp_printf(emitted == 1 ? "\n\"%Zu\"" : ",\n\"%Zu\"", x);
 		}
-		mpz_clear(avg);
-		mpz_clear(sum_bits);
 
+		// save as file
+		if (out != NULL) {
+			if (mpz_out_raw(out, x) > 0)
+				written++;
+		}
 	}
 
-	// print JSON
 	if (jflg > 0) {
-		printf("[\n");
-		for(i=0; i<s.used; i++) {
-			if (i == (s.used - 1)) {
-				gmp_printf("\"%Zu\"\n", s.array[i]);
+		printf("\n]\n");
+	}
+
+	if (read_count == 0) {
+		fprintf(stderr, "No integers loaded (empty file)\n");
+		return 3;
+	}
+
+	// print info
+	if (iflg > 0) {
+		printf("count: %zu\n", emitted);
+		if (emitted > 0) {
+			mpz_init(avg);
+			mpz_cdiv_q_ui(avg, sum_bits, emitted);
+			if (size_min == size_max) {
+				printf("size (all): %zu bit\n", size_min);
 			} else {
-				gmp_printf("\"%Zu\",\n", s.array[i]);
+				gmp_printf("size:\n  - min: %zu bit\n  - max: %zu bit\n  - avg: %Zu bit\n", size_min, size_max, avg);
 			}
+			mpz_clear(avg);
 		}
-		printf("]\n");
 	}
 
 	// print uniques
 	if (uflg > 0) {
-		array_init(&uniques, 10);
-		array_unique(&uniques, &s);
-		printf("unique: %zu / %zu\n", uniques.used, s.used);
-		array_clear(&uniques);
+		printf("unique: %zu / %zu\n", unique_count, emitted);
 	}
 
-	// save as file
-	if (out_filename != NULL) {
+	if (out != NULL) {
 		if (vflg > 0)
-			printf("storing output in '%s'\n", out_filename);
-		count = array_to_file(&s, out_filename);
-		if (s.used != count) {
+			printf("stored %zu integers in '%s'\n", written, out_filename);
+		if (out != stdout)
+			fclose(out);
+		if (written != emitted) {
 			fprintf(stderr, "Array size and write count do not match\n");
 			return 4;
 		}
 	}
 
-	array_clear(&s);
+	// Closes the sorted temporary file as well.
+	source_close(&src);
+	if ((sflg > 0 || uflg > 0) && mflg == 0)
+		array_clear(&s);
+	if (exclude_filename != NULL)
+		hashset_clear(&exclude);
+	if (keep_filename != NULL)
+		hashset_clear(&keep);
+	if (rflg > 0) {
+		array_clear(&sample);
+		gmp_randclear(randstate);
+	}
+	mpz_clear(x);
+	mpz_clear(last);
+	mpz_clear(prev);
+	mpz_clear(sum_bits);
 
 	return r;
 }
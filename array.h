@@ -6,6 +6,8 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+#include <stdio.h>
+
 typedef struct {
 	mpz_t * array;
 	size_t used;
@@ -28,8 +30,12 @@ int array_equal(mpz_array *a, mpz_array *b);
 
 void array_print(mpz_array *a);
 
+size_t array_of_stdio(mpz_array *a, FILE *in);
+
 size_t array_of_file(mpz_array *a, const char *filename);
 
+size_t array_to_stdio(mpz_array *a, FILE *out);
+
 size_t array_to_file(mpz_array *a, const char *filename);
 
 void array_msort(mpz_array *a);
@@ -9,28 +9,104 @@
 #include <unistd.h>
 #include <gmp.h>
 #include "copri.h"
+#include "hash.h"
+#include "extsort.h"
 
 #define MAX_CHUNK_NAME_LENGTH 256
 
+// A coprime base in the suggested merge tree of the manifest.
+typedef struct {
+	char name[MAX_CHUNK_NAME_LENGTH];
+	unsigned long long bits;
+} merge_node;
+
+static int merge_node_cmp(const void *a, const void *b) {
+	const merge_node *x = (const merge_node *)a, *y = (const merge_node *)b;
+	return (x->bits > y->bits) - (x->bits < y->bits);
+}
+
+// ## Manifest
+//
+// Writes `PREFIX.manifest` with one `chunk` line per chunk and the
+// suggested merge tree of the coprime bases as `merge` lines. The coprime
+// base of every chunk is computed with `app -b`, the bases are merged
+// pairwise with `app-merge -b`. Every round pairs the two smallest bases,
+// so the big merges are postponed to the last rounds. `app-merge -b
+// OUT-FILE CB-FILE...` runs the same merge tree in one process.
+static int write_manifest(const char *prefix, unsigned int padding,
+size_t *bounds, unsigned long long *bits, size_t chunk_count) {
+	char name[MAX_CHUNK_NAME_LENGTH];
+	merge_node *nodes;
+	size_t i, n, round;
+	FILE *f;
+
+	if (snprintf(name, MAX_CHUNK_NAME_LENGTH, "%s.manifest", prefix) >= MAX_CHUNK_NAME_LENGTH) {
+		fprintf(stderr, "Chunk name encoding error!\n");
+		return 5;
+	}
+	f = fopen(name, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Can't open %s\n", name);
+		return 4;
+	}
+	printf("writing manifest '%s'\n", name);
+
+	nodes = (merge_node *)malloc(chunk_count * sizeof(merge_node));
+	fprintf(f, "# chunk INDEX COUNT BITS LIST-FILE CB-FILE\n");
+	fprintf(f, "#   app -b CB-FILE LIST-FILE\n");
+	for (i = 0; i < chunk_count; i++) {
+		snprintf(nodes[i].name, MAX_CHUNK_NAME_LENGTH, "%s_%0*zu-%0*zu.cb", prefix, padding, bounds[i], padding, bounds[i+1]);
+		nodes[i].bits = bits[i];
+		fprintf(f, "chunk %zu %zu %llu %s_%0*zu-%0*zu.lst %s\n", i, bounds[i+1] - bounds[i], bits[i], prefix, padding, bounds[i], padding, bounds[i+1], nodes[i].name);
+	}
+
+	// The bits of a merged base are estimated by the sum of both bases.
+	fprintf(f, "# merge ROUND BITS OUT-FILE CB-FILE1 CB-FILE2\n");
+	fprintf(f, "#   app-merge -b OUT-FILE CB-FILE1 CB-FILE2\n");
+	for (n = chunk_count, round = 1; n > 1; round++) {
+		qsort(nodes, n, sizeof(merge_node), merge_node_cmp);
+		for (i = 0; i + 1 < n; i += 2) {
+			fprintf(f, "merge %zu %llu %s_r%zu-%zu.cb %s %s\n", round, nodes[i].bits + nodes[i+1].bits, prefix, round, i / 2, nodes[i].name, nodes[i+1].name);
+			nodes[i / 2].bits = nodes[i].bits + nodes[i+1].bits;
+			snprintf(nodes[i / 2].name, MAX_CHUNK_NAME_LENGTH, "%s_r%zu-%zu.cb", prefix, round, i / 2);
+		}
+		// An odd base is carried to the next round.
+		if (n % 2 == 1)
+			nodes[n / 2] = nodes[n - 1];
+		n = (n + 1) / 2;
+	}
+
+	free(nodes);
+	fclose(f);
+	return 0;
+}
+
 // The generic `main` function.
 //
 // Define all variables at the beginning to make the C99 compiler
 // happy.
 int main(int argc, char **argv) {
-	mpz_array s, uniques, o;
-	size_t count, chunk_count = 2, length, j, wc;
-	int c, vflg = 0, lflg = 0, nflg = 0, errflg = 0, r = 0;
+	mpz_array s, o;
+	size_t count, chunk_count = 2, length, j, wc, dups, bits;
+	size_t *bounds;
+	unsigned long long total_bits = 0, sum_bits, *chunk_bits;
+	int c, vflg = 0, lflg = 0, nflg = 0, mflg = 0, bflg = 0, errflg = 0, r = 0;
 	char *filename = "primes.lst";
 	char *out_filename = NULL;
 	char chunk_name[MAX_CHUNK_NAME_LENGTH];
 	long int level = 0, i, chunk_size_ui, index;
 	unsigned int padding = 9;
+	// for the external sort
+	long int memory = 0;
+	extsort_stats stats;
+	FILE *in = NULL;
+	mpz_t buf;
 
 	mpf_set_default_prec(64);
 
 	// #### argument parsing
 	// Boring `getopt` argument parsing.
-	while ((c = getopt(argc, argv, ":vnl:o:")) != -1) {
+	while ((c = getopt(argc, argv, ":vnbm:l:o:")) != -1) {
 		switch(c) {
 		case 'o':
 			out_filename = optarg;
@@ -41,6 +117,13 @@ int main(int argc, char **argv) {
 		case 'v':
 			vflg++;
 			break;
+		case 'b':
+			bflg++;
+			break;
+		case 'm':
+			mflg++;
+			memory = strtol(optarg, NULL, 0);
+			break;
 		case 'l':
 			lflg++;
 			level = strtol(optarg, NULL, 0);
@@ -61,53 +144,94 @@ int main(int argc, char **argv) {
 		errflg++;
 	}
 
+	if (mflg > 0 && memory <= 0) {
+		fprintf(stderr, "\n\t-m requires a memory budget > 0 MB!\n\n");
+		errflg++;
+	}
+
 	// Print the usage and exit if an error occurred during argument parsing.
 	if (errflg || lflg <= 0) {
-		fprintf(stderr, "usage: [-v] [-o FILE] [-l LENGTH] [file]\n"\
+		fprintf(stderr, "usage: [-vnb] [-m MB] [-o FILE] [-l LENGTH] [file]\n"\
                         "\n\t-o FILE   the output file prefix"\
 						"\n\t-l LEVEL  the level of the tree"\
 						"\n\t-n        do not sort and unique input"\
+						"\n\t-b        balance the chunks by bits instead of count"\
+						"\n\t-m MB     sort on disk with a memory budget of MB"\
                         "\n\t-v        be more verbose"\
                         "\n\n");
 		exit(2);
 	}
 
-	// Load the integers.
 	array_init(&s, 10);
-	count = array_of_file(&s, filename);
-	if (count == 0) {
-		fprintf(stderr, "Can't load %s\n", filename);
-		return 1;
-	}
-	if (s.used != count) {
-		fprintf(stderr, "Array size and load count do not match\n");
-		return 2;
-	}
-	if (s.used == 0) {
-		fprintf(stderr, "No integers loaded (empty file)\n");
-		return 3;
+	mpz_init(buf);
+	if (mflg > 0) {
+		// Sort and unique the input on disk, the chunks are streamed
+		// from the sorted temporary file.
+		if (nflg == 0) {
+			if (vflg > 0)
+				printf("sorting the input integers with a memory budget of %ld MB...\n", memory);
+			in = extsort_tmpfile(NULL);
+			if (in == NULL) {
+				fprintf(stderr, "Can't create a temporary file\n");
+				return 1;
+			}
+			r = extsort(in, (const char **)&filename, 1, memory * 1024 * 1024, 1, NULL, &stats);
+			if (r != 0) {
+				return r;
+			}
+			printf("unique: %zu / %zu\n", stats.written, stats.read);
+			count = stats.written;
+		} else {
+			in = fopen(filename, "r");
+			if (in == NULL) {
+				fprintf(stderr, "Can't load %s\n", filename);
+				return 1;
+			}
+			count = 0;
+			while (mpz_inp_raw(buf, in) > 0) {
+				count++;
+			}
+		}
+		rewind(in);
+		if (count == 0) {
+			fprintf(stderr, "No integers loaded (empty file)\n");
+			return 3;
+		}
+	} else {
+		// Load the integers.
+		count = array_of_file(&s, filename);
+		if (count == 0) {
+			fprintf(stderr, "Can't load %s\n", filename);
+			return 1;
+		}
+		if (s.used != count) {
+			fprintf(stderr, "Array size and load count do not match\n");
+			return 2;
+		}
+		if (s.used == 0) {
+			fprintf(stderr, "No integers loaded (empty file)\n");
+			return 3;
+		}
+
+		if (nflg == 0) {
+			// Remove the duplicates first, so only the unique integers
+			// have to be sorted.
+			if (vflg > 0)
+				printf("finding unique integers...\n");
+			dups = array_dedup(&s, NULL);
+			printf("unique: %zu / %zu\n", s.used, s.used + dups);
+
+			if (vflg > 0)
+				printf("sorting the input integers...\n");
+			array_msort(&s);
+		}
+		count = s.used;
 	}
 
 	if (out_filename != NULL && vflg > 0) {
 		printf("output is going to be saved in '%s'\n", out_filename);
 	}
 
-	if (nflg == 0) {
-		if (vflg > 0)
-			printf("sorting the input integers...\n");
-		array_msort(&s);
-
-		if (vflg > 0)
-			printf("finding unique integers...\n");
-		array_init(&uniques, 10);
-		array_unique(&uniques, &s);
-		printf("unique: %zu / %zu\n", uniques.used, s.used);
-
-		count = uniques.used;
-	} else {
-		count = s.used;
-	}
-
 	for (i=1; i<level; i++) {
 		chunk_count *= 2;
 	}
@@ -120,6 +244,25 @@ int main(int argc, char **argv) {
 		return 4;
 	}
 
+	if (bflg > 0) {
+		// The cost of a chunk is the size of its product, which is about
+		// the sum of the bit sizes of its integers.
+		for (j=0; j<count; j++) {
+			if (in != NULL) {
+				if (mpz_inp_raw(buf, in) == 0) {
+					fprintf(stderr, "Can't read the sorted integers\n");
+					return 2;
+				}
+				total_bits += mpz_sizeinbase(buf, 2);
+			} else {
+				total_bits += mpz_sizeinbase(s.array[j], 2);
+			}
+		}
+		if (in != NULL)
+			rewind(in);
+		printf("total bits: %llu, bits per chunk: %llu\n", total_bits, total_bits / chunk_count);
+	}
+
 	mpz_t chunk_size, rest, size;
 
 	mpz_init(chunk_size);
@@ -148,13 +291,20 @@ int main(int argc, char **argv) {
 		length = chunk_size_ui;
 
 		// generate the chunks
-		if (vflg > 0)
-			printf("creating chunks with prefix '%s' and size: %zu\n", out_filename, length);
-		array_init(&o, length);
+		if (vflg > 0) {
+			if (bflg > 0)
+				printf("creating chunks with prefix '%s' and about %llu bits\n", out_filename, total_bits / chunk_count);
+			else
+				printf("creating chunks with prefix '%s' and size: %zu\n", out_filename, length);
+		}
 
 		// get the padding size
 		padding = snprintf ( chunk_name, MAX_CHUNK_NAME_LENGTH, "%zu", count);
 
+		bounds = (size_t *)malloc((chunk_count + 1) * sizeof(size_t));
+		chunk_bits = (unsigned long long *)malloc(chunk_count * sizeof(unsigned long long));
+		sum_bits = 0;
+
 		index = 0;
 		for(i=0; i<chunk_count; i++) {
 
@@ -167,22 +317,47 @@ int main(int argc, char **argv) {
 				mpf_sub_ui(radio_at, radio_at, 1);
 			}
 
+			// In the bit balanced mode the length is only known after
+			// the chunk is filled, the chunk starts with the length by
+			// count and grows.
 			array_init(&o, length);
+			if (bflg > 0)
+				length = count - index;
+
+			bounds[i] = index;
+			chunk_bits[i] = 0;
 
 			for (j=0; j<length; j++) {
-				if (nflg == 0) {
-					array_add(&o, uniques.array[index+j]);
+				if (in != NULL) {
+					if (mpz_inp_raw(buf, in) == 0) {
+						fprintf(stderr, "Can't read the sorted integers\n");
+						return 2;
+					}
+					array_add(&o, buf);
 				} else {
 					array_add(&o, s.array[index+j]);
 				}
-
+				bits = mpz_sizeinbase(o.array[j], 2);
+				chunk_bits[i] += bits;
+				sum_bits += bits;
+
+				// Close the chunk as soon as it reaches its share of the
+				// total bits, but leave one integer for every following
+				// chunk. The last chunk takes the rest.
+				if (bflg > 0 && i + 1 < chunk_count &&
+				(sum_bits * chunk_count >= (i + 1) * total_bits ||
+				count - (index + j + 1) <= chunk_count - (i + 1))) {
+					j++;
+					break;
+				}
 			}
+			length = j;
 
 			if (snprintf ( chunk_name, MAX_CHUNK_NAME_LENGTH, "%s_%0*zu-%0*zu.lst", out_filename, padding, index, padding, index+j) < 0) {
 				fprintf(stderr, "Chunk name encoding error!\n");
 				return 5;
 			}
-			printf("writing chunk '%s' size: %zu\n", chunk_name, length);
+			printf("writing chunk '%s' size: %zu bits: %llu\n", chunk_name, length, chunk_bits[i]);
 
 
 			wc = array_to_file(&o, chunk_name);
@@ -194,6 +369,12 @@ int main(int argc, char **argv) {
 			index += length;
 			array_clear(&o);
 		}
+		bounds[chunk_count] = index;
+
+		r = write_manifest(out_filename, padding, bounds, chunk_bits, chunk_count);
+
+		free(bounds);
+		free(chunk_bits);
 	}
 
 	/*
@@ -322,9 +503,9 @@ console.log('rest', rest, restRatio);
 	*/
 
 	array_clear(&s);
-	if (nflg == 0) {
-		array_clear(&uniques);
-	}
+	mpz_clear(buf);
+	if (in != NULL)
+		fclose(in);
 
 	return r;
 }
@@ -0,0 +1,152 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This file contains the calibration of the leaf size of `cb` and
+// `find_factors`.
+//
+// The coprime base and the factors of a key set are computed for the leaf
+// sizes 1, 2, 4, ... and the fastest leaf size is printed. Use it with
+// `app -l LEAF`. Without a file a synthetic set of RSA keys is generated.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <gmp.h>
+#include "copri.h"
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Creates `count` keys with `bits` bit, every tenth key shares a prime
+// with the previous key.
+static void keys(mpz_array *s, size_t count, unsigned long bits) {
+	mpz_t p, q, x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(p);
+	mpz_init(q);
+	mpz_init(x);
+	for (i = 0; i < count; i++) {
+		if (i % 10 != 9) {
+			mpz_urandomb(p, state, bits / 2);
+			mpz_setbit(p, bits / 2 - 1);
+			mpz_nextprime(p, p);
+		}
+		mpz_urandomb(q, state, bits / 2);
+		mpz_setbit(q, bits / 2 - 1);
+		mpz_nextprime(q, q);
+		mpz_mul(x, p, q);
+		array_add(s, x);
+	}
+	mpz_clear(p);
+	mpz_clear(q);
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+// Returns the time of `cb` and `find_factors` with leaf size `leaf`.
+static double measure(mpz_array *s, size_t leaf) {
+	mpz_pool pool;
+	mpz_array p, out;
+	double t;
+
+	pool_init(&pool, 0);
+	array_init(&p, s->used);
+	array_init(&out, 10);
+	copri_set_leaf(leaf);
+
+	t = now();
+	array_cb(&pool, &p, s);
+	array_find_factors(&pool, &out, s, &p);
+	t = now() - t;
+
+	array_clear(&p);
+	array_clear(&out);
+	pool_clear(&pool);
+	return t;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array s;
+	long int count = 500, bits = 1024, max = 64;
+	size_t leaf, best = 1;
+	double t, t_best = 0;
+	int c, errflg = 0;
+	char *filename = NULL;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":n:b:m:")) != -1) {
+		switch(c) {
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			bits = strtol(optarg, NULL, 0);
+			break;
+		case 'm':
+			max = strtol(optarg, NULL, 0);
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (optind < argc) {
+		filename = argv[optind];
+		if (optind + 1 < argc) errflg++;
+	}
+
+	if (count <= 1 || bits < 16 || max < 1)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-n COUNT] [-b BITS] [-m MAX] [file]\n"\
+                        "\n\t-n COUNT  the count of synthetic keys"\
+                        "\n\t-b BITS   the bit size of the synthetic keys"\
+                        "\n\t-m MAX    the maximal leaf size"\
+                        "\n\n");
+		exit(2);
+	}
+
+	array_init(&s, count);
+	if (filename != NULL) {
+		if (array_of_file(&s, filename) == 0) {
+			fprintf(stderr, "Can't load %s\n", filename);
+			return 1;
+		}
+	} else {
+		keys(&s, count, bits);
+	}
+
+	printf("calibrating with %zu keys\n", s.used);
+	for (leaf = 1; leaf <= max; leaf *= 2) {
+		t = measure(&s, leaf);
+		printf("leaf %4zu: %.3f s\n", leaf, t);
+		if (leaf == 1 || t < t_best) {
+			t_best = t;
+			best = leaf;
+		}
+	}
+	printf("best leaf size: %zu (app -l %zu)\n", best, best);
+
+	array_clear(&s);
+	return 0;
+}
@@ -8,15 +8,412 @@
 // # Algorithm
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <gmp.h>
 #include "copri.h"
+#include "fixed.h"
 #include "config.h"
 #if USE_OPENMP
 #include <omp.h>
 #endif
 
+// ## Split strategy
+//
+// The divide and conquer algorithms split their input set into two
+// halves. By default the halves have the same count of integers. With
+// `COPRI_SPLIT_BITS` the cut is placed at half of the total bit length,
+// so both products have about the same size even if the integers have
+// very different sizes (e.g. 512 and 4096 bit keys). The results do not
+// depend on the strategy.
+static int split_strategy = COPRI_SPLIT_COUNT;
+
+void copri_set_split(int strategy) {
+	split_strategy = strategy;
+}
+
+int copri_get_split() {
+	return split_strategy;
+}
+
+// ## Leaf size
+//
+// `cb` and `find_factors` stop the recursion at subsets of at most
+// `leaf_size` integers and handle them directly by pairwise gcds, which
+// is faster for small subsets. The default of 1 recurses down to single
+// integers. `calibrate` finds the best leaf size for a machine.
+static size_t leaf_size = 1;
+
+void copri_set_leaf(size_t size) {
+	leaf_size = size < 1 ? 1 : size;
+}
+
+size_t copri_get_leaf() {
+	return leaf_size;
+}
+
+// ## Parallel multiplication
+//
+// At the top of the product trees a single multiplication of two huge
+// integers runs on one core while the other threads are idle. Operands
+// with at least `mul_threshold` limbs are therefore split into k blocks
+// of limbs each, and the k^2 block products are computed by `mpn_mul` in
+// parallel and added at their limb offsets. With k = sqrt(threads) the
+// multiplication finishes about k times faster. Inside a parallel region
+// (e.g. in the subtrees of `cb`) `mpz_mul` is used.
+static size_t mul_threshold = 1 << 16;
+
+void copri_set_mul_threshold(size_t limbs) {
+	mul_threshold = limbs < 2 ? 2 : limbs;
+}
+
+size_t copri_get_mul_threshold() {
+	return mul_threshold;
+}
+
+// Returns the count k of blocks per operand, or 1 if the parallel kernels
+// are not used.
+static size_t mul_blocks() {
+	size_t k = 1;
+#if USE_OPENMP
+	if (omp_in_parallel())
+		return 1;
+	while ((k + 1) * (k + 1) <= (size_t)omp_get_max_threads())
+		k++;
+#endif
+	return k;
+}
+
+// Compute `rot` = `a` * `b`. `rot` may be `a` or `b`.
+//
+// See [parmul test](test-parmul.html) for basic usage.
+void parallel_mul(mpz_t rot, const mpz_t a, const mpz_t b) {
+#if USE_OPENMP
+	size_t an = mpz_size(a), bn = mpz_size(b), rn = an + bn, k = mul_blocks();
+	size_t ca, cb, t, i, j, *off, *len;
+	const mp_limb_t *ap, *bp;
+	mp_limb_t *rp, **parts;
+	const int square = a == b;
+	mpz_t r;
+
+	if (k < 2 || an < mul_threshold || bn < mul_threshold) {
+		mpz_mul(rot, a, b);
+		return;
+	}
+
+	ca = (an + k - 1) / k;
+	cb = (bn + k - 1) / k;
+	ap = mpz_limbs_read(a);
+	bp = mpz_limbs_read(b);
+	parts = (mp_limb_t **)calloc(k * k, sizeof(mp_limb_t *));
+	off = (size_t *)calloc(k * k, sizeof(size_t));
+	len = (size_t *)calloc(k * k, sizeof(size_t));
+
+	// The block product (i, j) is a_i * b_j. For a square the product
+	// (j, i) equals (i, j) and is added twice.
+#pragma omp parallel for schedule(dynamic) private(i, j)
+	for (t = 0; t < k * k; t++) {
+		size_t ai, bj;
+		i = t / k;
+		j = t % k;
+		if (i * ca >= an || j * cb >= bn || (square && j < i))
+			continue;
+		ai = an - i * ca < ca ? an - i * ca : ca;
+		bj = bn - j * cb < cb ? bn - j * cb : cb;
+		off[t] = i * ca + j * cb;
+		len[t] = ai + bj;
+		parts[t] = (mp_limb_t *)malloc(len[t] * sizeof(mp_limb_t));
+		if (ai >= bj)
+			mpn_mul(parts[t], ap + i * ca, ai, bp + j * cb, bj);
+		else
+			mpn_mul(parts[t], bp + j * cb, bj, ap + i * ca, ai);
+	}
+
+	// Sum up the block products. The sum fits, so there is no carry out.
+	mpz_init(r);
+	rp = mpz_limbs_write(r, rn);
+	for (t = 0; t < rn; t++) {
+		rp[t] = 0;
+	}
+	for (t = 0; t < k * k; t++) {
+		if (parts[t] == NULL)
+			continue;
+		mpn_add(rp + off[t], rp + off[t], rn - off[t], parts[t], len[t]);
+		if (square && t / k != t % k)
+			mpn_add(rp + off[t], rp + off[t], rn - off[t], parts[t], len[t]);
+		free(parts[t]);
+	}
+	while (rn > 0 && rp[rn - 1] == 0)
+		rn--;
+	mpz_limbs_finish(r, rn);
+	if (mpz_sgn(a) * mpz_sgn(b) < 0)
+		mpz_neg(r, r);
+	mpz_swap(rot, r);
+
+	mpz_clear(r);
+	free(parts);
+	free(off);
+	free(len);
+#else
+	mpz_mul(rot, a, b);
+#endif
+}
+
+// ## Parallel division
+//
+// The divisions and gcds near the root of `cbextend` and `find_factors`
+// have operands of the size of the products. A quotient of at least
+// `mul_threshold` limbs is computed with a Newton reciprocal of the
+// divisor, so all the work is done by `parallel_mul`:
+//
+//     x ≈ 2^(m-1+P) / d          (m = bits of d, P = bits of q + guard)
+//     q ≈ (a / 2^(m-1)) x / 2^P
+//
+// The approximate quotient is corrected by the remainder, so the result is
+// exact however good the reciprocal is.
+//
+// This is more than twice the work of the division of GMP, so it is only
+// used with at least `DIVISION_BLOCKS` blocks per operand (9 threads),
+// where it is faster.
+#define RECIPROCAL_GUARD 64
+#define DIVISION_BLOCKS 3
+
+// Compute `x` ≈ 2^(m-1+P) / `d` with an error of a few units. Only the top
+// P + `RECIPROCAL_GUARD` bits of `d` are used. Every Newton step
+//
+//     x ← x + x (2^(m-1+P) - d x) / 2^(m-1+P)
+//
+// doubles the precision, the recursion stops at `mul_threshold` limbs.
+static void reciprocal(mpz_t x, const mpz_t d, size_t p) {
+	size_t m = mpz_sizeinbase(d, 2), s, h;
+	mpz_t t, e;
+
+	mpz_init(t);
+	mpz_init(e);
+	s = m > p + RECIPROCAL_GUARD ? m - p - RECIPROCAL_GUARD : 0;
+	mpz_fdiv_q_2exp(t, d, s);
+	m -= s;
+
+	if (p <= mul_threshold * GMP_NUMB_BITS) {
+		mpz_set_ui(x, 0);
+		mpz_setbit(x, m - 1 + p);
+		mpz_fdiv_q(x, x, t);
+	} else {
+		h = p / 2 + RECIPROCAL_GUARD / 2;
+		reciprocal(x, t, h);
+		mpz_mul_2exp(x, x, p - h);
+		mpz_set_ui(e, 0);
+		mpz_setbit(e, m - 1 + p);
+		parallel_mul(t, t, x);
+		mpz_sub(e, e, t);
+		parallel_mul(e, e, x);
+		mpz_fdiv_q_2exp(e, e, m - 1 + p);
+		mpz_add(x, x, e);
+	}
+	mpz_clear(t);
+	mpz_clear(e);
+}
+
+// Compute `q` = floor(`a` / `d`) and `r` = `a` - `q` `d` like `mpz_fdiv_qr`.
+// `q` and `r` may be `a` or `d`.
+//
+// See [pardiv test](test-pardiv.html) for basic usage.
+void parallel_fdiv_qr(mpz_t q, mpz_t r, const mpz_t a, const mpz_t d) {
+	size_t n, m, p;
+	mpz_t x, y, z;
+
+	if (mul_blocks() < DIVISION_BLOCKS || mpz_sgn(a) <= 0 || mpz_sgn(d) <= 0 ||
+	mpz_size(d) < mul_threshold || mpz_size(a) < mpz_size(d) + mul_threshold) {
+		mpz_fdiv_qr(q, r, a, d);
+		return;
+	}
+
+	n = mpz_sizeinbase(a, 2);
+	m = mpz_sizeinbase(d, 2);
+	p = n - m + 1 + RECIPROCAL_GUARD;
+	mpz_init(x);
+	mpz_init(y);
+	mpz_init(z);
+
+	reciprocal(x, d, p);
+	mpz_fdiv_q_2exp(y, a, m - 1);
+	parallel_mul(y, y, x);
+	mpz_fdiv_q_2exp(y, y, p);
+
+	// Correct y by the remainder a - y d, which is a small multiple of d.
+	parallel_mul(z, y, d);
+	mpz_sub(z, a, z);
+	mpz_fdiv_qr(x, z, z, d);
+	mpz_add(y, y, x);
+
+	mpz_swap(q, y);
+	mpz_swap(r, z);
+	mpz_clear(x);
+	mpz_clear(y);
+	mpz_clear(z);
+}
+
+// Compute `q` = floor(`a` / `d`) like `mpz_fdiv_q`.
+void parallel_fdiv_q(mpz_t q, const mpz_t a, const mpz_t d) {
+	mpz_t r;
+
+	if (mul_blocks() < DIVISION_BLOCKS) {
+		mpz_fdiv_q(q, a, d);
+		return;
+	}
+	mpz_init(r);
+	parallel_fdiv_qr(q, r, a, d);
+	mpz_clear(r);
+}
+
+// Compute `g` = gcd(`a`, `b`). If one operand is much bigger the gcd
+// starts with its remainder modulo the other one by `parallel_fdiv_qr`,
+// the gcd of the balanced operands is left to `mpz_gcd`.
+void parallel_gcd(mpz_t g, const mpz_t a, const mpz_t b) {
+	mpz_t q, r;
+
+	if (mpz_size(a) < mpz_size(b)) {
+		parallel_gcd(g, b, a);
+		return;
+	}
+	if (mul_blocks() < DIVISION_BLOCKS || mpz_sgn(a) <= 0 || mpz_sgn(b) <= 0 ||
+	mpz_size(b) < mul_threshold || mpz_size(a) < mpz_size(b) + mul_threshold) {
+		mpz_gcd(g, a, b);
+		return;
+	}
+	mpz_init(q);
+	mpz_init(r);
+	parallel_fdiv_qr(q, r, a, b);
+	mpz_gcd(g, b, r);
+	mpz_clear(q);
+	mpz_clear(r);
+}
+
+// ## Prepared modulus
+//
+// A product tree node is often used for several reductions, e.g. the
+// product of P in `cbextend` for ppi(b, prod P) and at the root of
+// `split`. A prepared modulus computes the product only once and keeps
+// the Newton reciprocal of it, so every reduction by it only multiplies.
+// The numerator is reduced by blocks of the limb count L of the modulus
+// n (Barrett reduction):
+//
+//     t ← r 2^(64 L) + next block of a     (t < n 2^(64 L))
+//     q ≈ (t / 2^(m-1)) x / 2^P
+//     r ← t - q n
+//
+// On a single core this is about as fast as the division of GMP, so the
+// reciprocal is only computed if the parallel kernels are used, i.e. with
+// at least `DIVISION_BLOCKS` blocks and `mul_threshold` limbs.
+//
+// The modulus is not copied, `n` has to live as long as `m`.
+void modulus_init(copri_modulus *m, const mpz_t n) {
+	m->n = n;
+	mpz_init(m->x);
+	m->p = 0;
+	if (mul_blocks() >= DIVISION_BLOCKS && mpz_sgn(n) > 0 &&
+	mpz_size(n) >= mul_threshold) {
+		m->p = mpz_size(n) * GMP_NUMB_BITS + RECIPROCAL_GUARD;
+		reciprocal(m->x, n, m->p);
+	}
+}
+
+void modulus_clear(copri_modulus *m) {
+	mpz_clear(m->x);
+}
+
+// Compute `r` = `a` mod n like `mpz_fdiv_r`. `r` may be `a`.
+//
+// See [modulus test](test-modulus.html) for basic usage.
+void modulus_fdiv_r(mpz_t r, const mpz_t a, const copri_modulus *m) {
+	size_t l = mpz_size(m->n), n = mpz_size(a), bits, off, c;
+	const mp_limb_t *ap;
+	mpz_t t, q, v, w;
+
+	if (m->p == 0 || mpz_sgn(a) < 0 || n <= l) {
+		mpz_fdiv_r(r, a, m->n);
+		return;
+	}
+
+	bits = mpz_sizeinbase(m->n, 2);
+	ap = mpz_limbs_read(a);
+	mpz_init(t);
+	mpz_init(q);
+	mpz_init(v);
+
+	// Start with the top block, which is shorter if L does not divide the
+	// limb count of a.
+	c = n % l ? n % l : l;
+	off = n - c;
+	while (1) {
+		mpz_mul_2exp(t, v, c * GMP_NUMB_BITS);
+		mpz_add(t, t, mpz_roinit_n(w, ap + off, c));
+		mpz_fdiv_q_2exp(q, t, bits - 1);
+		parallel_mul(q, q, m->x);
+		mpz_fdiv_q_2exp(q, q, m->p);
+		parallel_mul(q, q, m->n);
+		mpz_sub(t, t, q);
+		while (mpz_sgn(t) < 0)
+			mpz_add(t, t, m->n);
+		while (mpz_cmp(t, m->n) >= 0)
+			mpz_sub(t, t, m->n);
+		mpz_swap(v, t);
+		if (off == 0)
+			break;
+		c = l;
+		off -= l;
+	}
+
+	mpz_swap(r, v);
+	mpz_clear(t);
+	mpz_clear(q);
+	mpz_clear(v);
+}
+
+// Computes the prefix sums of the bit lengths of `a[from..to]`. The sum
+// of `a[from..i-1]` is stored in `bits[i]`. Returns `NULL` if the split
+// by count is used.
+static size_t *split_bits(mpz_t *a, size_t from, size_t to) {
+	size_t i, *bits;
+
+	if (split_strategy != COPRI_SPLIT_BITS || to - from < 2)
+		return NULL;
+	bits = (size_t *)malloc((to + 2) * sizeof(size_t));
+	bits[from] = 0;
+	for (i = from; i <= to; i++) {
+		bits[i+1] = bits[i] + mpz_sizeinbase(a[i], 2);
+	}
+	return bits;
+}
 
+// Returns the last index of the first half of `from..to`. Without
+// prefix sums this is `to - n/2 - 1`. Otherwise the index closest to half
+// of the bits is found by a binary search, both halves are never empty.
+static size_t split_at(const size_t *bits, size_t from, size_t to) {
+	size_t lo = from, hi = to - 1, m, half;
+
+	if (bits == NULL)
+		return to - (to - from)/2 - 1;
+
+	half = bits[from] + (bits[to+1] - bits[from]) / 2;
+	while (lo < hi) {
+		m = lo + (hi - lo) / 2;
+		if (bits[m+1] < half)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	if (lo > from && bits[lo+1] >= half && half - bits[lo] < bits[lo+1] - half)
+		lo--;
+	return lo;
+}
 
 // ###Compute a^2^n.
 
@@ -29,7 +426,7 @@
 // See [twopower test](test-twopower.html) for basic usage.
 void two_power(mpz_t rot, unsigned long long n) {
 	while(n > 0) {
-		mpz_mul(rot, rot, rot);
+		parallel_mul(rot, rot, rot);
 		n--;
 	}
 }
@@ -45,24 +442,31 @@ void two_power(mpz_t rot, unsigned long long n) {
 // Algorithm 11.3 [PDF page 14](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [gcdppippo test](test-gcdppippo.html) for basic usage.
-void gcd_ppi_ppo(mpz_pool *pool, mpz_t gcd, mpz_t ppi, mpz_t
-ppo, const mpz_t a, const mpz_t b) {
+//
+// `ppi_ppo_of_gcd` continues with gcd(a,b) already in `ppi`.
+static void ppi_ppo_of_gcd(mpz_pool *pool, mpz_t ppi, mpz_t ppo,
+const mpz_t a) {
 	mpz_t g;
 	pool_pop(pool, g);
-	mpz_gcd(ppi, a, b);
-	mpz_set(gcd, ppi);
-	mpz_fdiv_q(ppo, a, ppi);
+	parallel_fdiv_q(ppo, a, ppi);
 	while(1) {
-		mpz_gcd(g, ppi, ppo);
+		parallel_gcd(g, ppi, ppo);
 		if (mpz_cmp_ui(g, 1) == 0) {
 			pool_push(pool, g);
 			return;
 		}
-		mpz_mul(ppi, ppi, g);
-		mpz_fdiv_q(ppo, ppo, g);
+		parallel_mul(ppi, ppi, g);
+		parallel_fdiv_q(ppo, ppo, g);
 	}
 }
 
+void gcd_ppi_ppo(mpz_pool *pool, mpz_t gcd, mpz_t ppi, mpz_t
+ppo, const mpz_t a, const mpz_t b) {
+	parallel_gcd(ppi, a, b);
+	mpz_set(gcd, ppi);
+	ppi_ppo_of_gcd(pool, ppi, ppo, a);
+}
+
 // #### Shortcuts
 
 // Compute ppi and ppo. Ingore gcd.
@@ -86,6 +490,28 @@ const mpz_t c) {
 	pool_push(pool, ppo);
 }
 
+// Compute ppi and ppo for a prepared modulus. The gcd starts with the
+// remainder of `a` modulo the prepared modulus.
+void modulus_ppi_ppo(mpz_pool *pool, mpz_t ppi, mpz_t ppo,
+const mpz_t a, const copri_modulus *m) {
+	if (mpz_cmp(a, m->n) > 0) {
+		modulus_fdiv_r(ppi, a, m);
+		mpz_gcd(ppi, m->n, ppi);
+	} else {
+		parallel_gcd(ppi, a, m->n);
+	}
+	ppi_ppo_of_gcd(pool, ppi, ppo, a);
+}
+
+// Compute ppi for a prepared modulus. Ingore ppo.
+void modulus_ppi(mpz_pool *pool, mpz_t ppi, const mpz_t a,
+const copri_modulus *m) {
+	mpz_t ppo;
+	pool_pop(pool, ppo);
+	modulus_ppi_ppo(pool, ppi, ppo, a, m);
+	pool_push(pool, ppo);
+}
+
 // ### Compute gcd, ppg and pple
 
 //     gcd  =  gcd(a,b)  greatest common divisor
@@ -101,17 +527,17 @@ void gcd_ppg_pple(mpz_pool *pool, mpz_t gcd, mpz_t ppg,
 mpz_t pple, const mpz_t a, const mpz_t b) {
 	mpz_t g;
 	pool_pop(pool, g);
-	mpz_gcd(pple, a, b);
+	parallel_gcd(pple, a, b);
 	mpz_set(gcd, pple);
-	mpz_fdiv_q(ppg, a, pple);
+	parallel_fdiv_q(ppg, a, pple);
 	while(1) {
-		mpz_gcd(g, ppg, pple);
+		parallel_gcd(g, ppg, pple);
 		if (mpz_cmp_ui(g, 1) == 0) {
 			pool_push(pool, g);
 			return;
 		}
-		mpz_mul(ppg, ppg, g);
-		mpz_fdiv_q(pple, pple, g);
+		parallel_mul(ppg, ppg, g);
+		parallel_fdiv_q(pple, pple, g);
 	}
 }
 
@@ -254,9 +680,24 @@ const mpz_t b) {
 // Algorithm 14.1 [PDF page 19](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [prod test](test-prod.html) for basic usage.
-void prod(mpz_pool *pool, mpz_t rot, mpz_t * array,
-size_t from, size_t to) {
-	size_t n = to - from;
+//
+// Multiplies two keys of a common width directly with the fixed width
+// kernel and returns 1, or returns 0 if there is no kernel for them.
+static int fixed_mul(mpz_t rot, const mpz_t a, const mpz_t b) {
+	const fixed_kernel *k;
+
+	if (rot != a && rot != b && mpz_sgn(a) > 0 && mpz_sgn(b) > 0 &&
+	mpz_size(a) == mpz_size(b) &&
+	(k = fixed_kernel_for(mpz_size(a))) != NULL) {
+		k->mul(rot, a, b);
+		return 1;
+	}
+	return 0;
+}
+
+static void prod_rec(mpz_pool *pool, mpz_t rot, mpz_t * array,
+size_t from, size_t to, const size_t *bits) {
+	size_t n = to - from, m;
 	mpz_t x, y;
 
 	//  If #S = 1: Find a ∈ S. Print a. Stop.
@@ -265,24 +706,37 @@ size_t from, size_t to) {
 		return;
 	}
 
+	// Multiply two keys without copies of both operands.
+	if (n == 1 && fixed_mul(rot, array[from], array[to]))
+		return;
+
 	// Select T ⊆ S with #T = b#S/2c.
 	//
 	// Compute X ← prod(T).
+	m = split_at(bits, from, to);
 	pool_pop(pool, x);
-	prod(pool, x, array, from, to - n/2 - 1);
+	prod_rec(pool, x, array, from, m, bits);
 
 	// Compute Y ← prod(S−T).
 	pool_pop(pool, y);
-	prod(pool, y, array, to - n/2, to);
+	prod_rec(pool, y, array, m + 1, to, bits);
 
 	// Print XY.
-	mpz_mul(rot, x, y);
+	parallel_mul(rot, x, y);
 
 	// Free the memory.
 	pool_push(pool, x);
 	pool_push(pool, y);
 }
 
+void prod(mpz_pool *pool, mpz_t rot, mpz_t * array,
+size_t from, size_t to) {
+	size_t *bits = split_bits(array, from, to);
+
+	prod_rec(pool, rot, array, from, to, bits);
+	free(bits);
+}
+
 // #### array verison
 // Compute product of an `mpz_array` and store it in `mpz_t rot`.
 void array_prod(mpz_pool *pool, mpz_array *a, mpz_t rot) {
@@ -294,6 +748,472 @@ void array_prod(mpz_pool *pool, mpz_array *a, mpz_t rot) {
 }
 
 
+// ### Product trees
+
+// `split`, `find_factor` and `find_factors` need the product of every
+// subset of their recursion. Instead of computing the products again at
+// every node, the products of the nodes are computed once bottom up and
+// kept in a tree.
+//
+// The 2n-1 nodes of `array[from..to]` are stored in preorder: the node of
+// `from..to` is followed by the left subtree of `from..m` (2(m-from)+1
+// nodes) and then by the right subtree. The leaves are read only views of
+// the integers in `array`. If `root` is not `NULL` the root is a view of
+// its modulus.
+//
+// A complete tree needs memory for one product per level. Only every
+// `tree_step`-th level is kept (the root always), a missing node is
+// recomputed from the kept level below when it is needed. The recomputed
+// nodes below it are needed next by the recursion, so they are all freed
+// only when its subtree is done (`tree_get` and `tree_put`) and every
+// node is computed once. With a memory budget the
+// step is the smallest one for which the kept levels fit into it.
+//
+// If a tree directory is set and the kept levels do not fit into the
+// memory budget either (without a budget: the product of the whole array
+// has at least `tree_disk_bytes`, 64 MB by default), the kept nodes are written to one file per level in
+// the raw gmp format (`mpz_out_raw`) as soon as their parent is computed.
+// The files are unlinked at once and memory mapped after the build. The
+// recursions visit the nodes of every level from left to right, which is
+// the order of the file, so the mappings are read sequentially. A node is
+// loaded by `tree_get` and its pages are given back by `tree_put`.
+#define TREE_MISSING 0
+#define TREE_KEPT 1
+#define TREE_VIEW 2
+#define TREE_TEMPORARY 3
+#define TREE_DISK 4
+#define TREE_LOADED 5
+
+// The deeper levels of very unbalanced trees share the last file.
+#define TREE_MAX_FILES 64
+
+typedef struct {
+	mpz_t *node;
+	unsigned char *state;
+	mpz_t *array;
+	const size_t *bits;
+	size_t step;
+	// The disk mode: file and offset of every node on disk.
+	int disk;
+	unsigned char *file;
+	off_t *offset;
+	FILE *files[TREE_MAX_FILES];
+	unsigned char *maps[TREE_MAX_FILES];
+	size_t map_sizes[TREE_MAX_FILES];
+} prod_tree;
+
+static size_t tree_step = 1;
+static size_t tree_memory = 0;
+static const char *tree_dir = NULL;
+static size_t tree_disk_bytes = (size_t)64 << 20;
+
+void copri_set_tree_step(size_t step) {
+	tree_step = step < 1 ? 1 : step;
+}
+
+size_t copri_get_tree_step() {
+	return tree_step;
+}
+
+void copri_set_tree_memory(size_t bytes) {
+	tree_memory = bytes;
+}
+
+size_t copri_get_tree_memory() {
+	return tree_memory;
+}
+
+void copri_set_tree_dir(const char *dir) {
+	tree_dir = dir;
+}
+
+const char *copri_get_tree_dir() {
+	return tree_dir;
+}
+
+void copri_set_tree_disk_bytes(size_t bytes) {
+	tree_disk_bytes = bytes;
+}
+
+size_t copri_get_tree_disk_bytes() {
+	return tree_disk_bytes;
+}
+
+static size_t tree_right(size_t from, size_t m) {
+	return 2 * (m - from) + 2;
+}
+
+static void tree_view(mpz_t node, const mpz_t a) {
+	mpz_roinit_n(node, mpz_limbs_read(a),
+		mpz_sgn(a) * (mp_size_t)mpz_size(a));
+}
+
+// Computes the node `k` of `from..to` from its children.
+static void tree_mul(prod_tree *t, size_t k, size_t from, size_t to) {
+	size_t r = k + tree_right(from, split_at(t->bits, from, to));
+
+	mpz_init(t->node[k]);
+	if (!fixed_mul(t->node[k], t->node[k + 1], t->node[r]))
+		parallel_mul(t->node[k], t->node[k + 1], t->node[r]);
+}
+
+// Returns the mapping of the node `k` and its length in the raw format.
+static const unsigned char *tree_raw(prod_tree *t, size_t k, size_t *len) {
+	const unsigned char *raw = t->maps[t->file[k]] + t->offset[k];
+	int32_t size = (int32_t)((uint32_t)raw[0] << 24 | (uint32_t)raw[1] << 16 |
+		(uint32_t)raw[2] << 8 | (uint32_t)raw[3]);
+
+	*len = 4 + (size < 0 ? -size : size);
+	return raw;
+}
+
+// Frees the node `k` if it is only computed or loaded for a single use.
+static void tree_free(prod_tree *t, size_t k) {
+	const unsigned char *raw;
+	uintptr_t page = sysconf(_SC_PAGESIZE), start, end;
+	size_t len;
+
+	if (t->state[k] == TREE_TEMPORARY) {
+		mpz_clear(t->node[k]);
+		t->state[k] = TREE_MISSING;
+	} else if (t->state[k] == TREE_LOADED) {
+		mpz_clear(t->node[k]);
+		t->state[k] = TREE_DISK;
+
+		// The pages which only hold this node are not needed any more.
+		raw = tree_raw(t, k, &len);
+		start = ((uintptr_t)raw + page - 1) / page * page;
+		end = ((uintptr_t)raw + len) / page * page;
+		if (start < end)
+			madvise((void *)start, end - start, MADV_DONTNEED);
+	}
+}
+
+// Sets `x` to the node `k` in its file.
+static void tree_import(prod_tree *t, size_t k, mpz_t x) {
+	const unsigned char *raw;
+	size_t len;
+
+	raw = tree_raw(t, k, &len);
+	mpz_import(x, len - 4, 1, 1, 1, 0, raw + 4);
+	if (raw[0] & 0x80)
+		mpz_neg(x, x);
+}
+
+// Loads the node `k` from its file.
+static void tree_load(prod_tree *t, size_t k) {
+	mpz_init(t->node[k]);
+	tree_import(t, k, t->node[k]);
+	t->state[k] = TREE_LOADED;
+}
+
+// Returns the product of the node `k` of `from..to`, a missing node is
+// recomputed. The recomputed nodes below it are kept as well, as the
+// recursions descend into them next. Give it back with `tree_put` when
+// its subtree is done.
+static mpz_ptr tree_get(prod_tree *t, size_t k, size_t from, size_t to) {
+	size_t m;
+
+	if (t->state[k] == TREE_DISK)
+		tree_load(t, k);
+	if (t->state[k] != TREE_MISSING)
+		return t->node[k];
+	m = split_at(t->bits, from, to);
+	tree_get(t, k + 1, from, m);
+	tree_get(t, k + tree_right(from, m), m + 1, to);
+	tree_mul(t, k, from, to);
+	t->state[k] = TREE_TEMPORARY;
+	return t->node[k];
+}
+
+// Frees the node `k` of `from..to` and the recomputed nodes below it
+// which are still there.
+static void tree_put(prod_tree *t, size_t k, size_t from, size_t to) {
+	size_t m;
+
+	if (t->state[k] == TREE_TEMPORARY) {
+		m = split_at(t->bits, from, to);
+		tree_put(t, k + 1, from, m);
+		tree_put(t, k + tree_right(from, m), m + 1, to);
+	}
+	tree_free(t, k);
+}
+
+// Returns the product of the node `k` of `from..to` like `tree_get`, but
+// the tree is not changed: a node on disk or a missing node is loaded or
+// recomputed into `x`. Several threads can read a tree this way.
+static mpz_srcptr tree_read(prod_tree *t, size_t k, size_t from, size_t to,
+mpz_t x) {
+	mpz_srcptr a, b;
+	mpz_t l, r;
+	size_t m;
+
+	if (t->state[k] == TREE_DISK) {
+		tree_import(t, k, x);
+		return x;
+	}
+	if (t->state[k] != TREE_MISSING)
+		return t->node[k];
+	m = split_at(t->bits, from, to);
+	mpz_init(l);
+	mpz_init(r);
+	a = tree_read(t, k + 1, from, m, l);
+	b = tree_read(t, k + tree_right(from, m), m + 1, to, r);
+	if (!fixed_mul(x, a, b))
+		parallel_mul(x, a, b);
+	mpz_clear(l);
+	mpz_clear(r);
+	return x;
+}
+
+// Writes the kept node `k` of level `depth` to disk if the disk mode is
+// used, otherwise it is freed if it is not kept.
+static void tree_retire(prod_tree *t, size_t k, size_t depth) {
+	size_t f = depth < TREE_MAX_FILES ? depth : TREE_MAX_FILES - 1;
+	int fd;
+
+	if (!t->disk || t->state[k] != TREE_KEPT) {
+		tree_free(t, k);
+		return;
+	}
+	if (t->files[f] == NULL) {
+		char *name = (char *)malloc(strlen(tree_dir) + 32);
+		sprintf(name, "%s/copri-tree-XXXXXX", tree_dir);
+		fd = mkstemp(name);
+		if (fd >= 0) {
+			unlink(name);
+			t->files[f] = fdopen(fd, "w+");
+		}
+		free(name);
+		if (t->files[f] == NULL) {
+			fprintf(stderr, "Can't create a tree file in %s, keeping the level in memory\n", tree_dir);
+			return;
+		}
+	}
+	t->file[k] = f;
+	t->offset[k] = ftello(t->files[f]);
+	if (mpz_out_raw(t->files[f], t->node[k]) == 0) {
+		fprintf(stderr, "Can't write a tree node, keeping it in memory\n");
+		return;
+	}
+	mpz_clear(t->node[k]);
+	t->state[k] = TREE_DISK;
+}
+
+static void tree_build(prod_tree *t, size_t k, size_t from, size_t to,
+size_t depth, const copri_modulus *root) {
+	size_t m;
+
+	if (from == to) {
+		tree_view(t->node[k], t->array[from]);
+		t->state[k] = TREE_VIEW;
+		return;
+	}
+	m = split_at(t->bits, from, to);
+	tree_build(t, k + 1, from, m, depth + 1, NULL);
+	tree_build(t, k + tree_right(from, m), m + 1, to, depth + 1, NULL);
+	if (root != NULL) {
+		tree_view(t->node[k], root->n);
+		t->state[k] = TREE_VIEW;
+	} else {
+		tree_mul(t, k, from, to);
+		t->state[k] = depth % t->step == 0 ? TREE_KEPT : TREE_TEMPORARY;
+	}
+	tree_retire(t, k + 1, depth + 1);
+	tree_retire(t, k + tree_right(from, m), depth + 1);
+}
+
+// Returns the step for the memory budget: about one product of the whole
+// array (`bytes`) is kept for every kept level.
+static size_t tree_budget_step(mpz_t * array, size_t from, size_t to,
+size_t *bytes) {
+	size_t i, levels = 0, step;
+
+	*bytes = 0;
+	for (i = from; i <= to; i++) {
+		*bytes += mpz_size(array[i]) * sizeof(mp_limb_t);
+	}
+	for (i = to - from; i > 0; i /= 2) {
+		levels++;
+	}
+	for (step = 1; step < levels; step++) {
+		if (*bytes * ((levels + step - 1) / step) <= tree_memory)
+			break;
+	}
+	return step;
+}
+
+// Maps the level files of the `n` nodes after the build. If a file could
+// not be written completely (e.g. the disk is full), mapping it would
+// fault on the missing pages, so its nodes are recomputed when needed.
+static void tree_map(prod_tree *t, size_t n) {
+	struct stat st;
+	size_t f, k;
+	off_t size;
+	int fd;
+
+	for (f = 0; f < TREE_MAX_FILES; f++) {
+		if (t->files[f] == NULL)
+			continue;
+		fd = fileno(t->files[f]);
+		size = ftello(t->files[f]);
+		t->maps[f] = NULL;
+		if (fflush(t->files[f]) == 0 && !ferror(t->files[f]) &&
+		fstat(fd, &st) == 0 && st.st_size >= size) {
+			t->map_sizes[f] = size;
+			t->maps[f] = (unsigned char *)mmap(NULL, t->map_sizes[f], PROT_READ,
+				MAP_SHARED, fd, 0);
+		}
+		if (t->maps[f] == NULL || t->maps[f] == MAP_FAILED) {
+			fprintf(stderr, "Can't map a tree file in %s, recomputing its nodes\n", tree_dir);
+			for (k = 0; k < n; k++) {
+				if (t->state[k] == TREE_DISK && t->file[k] == f)
+					t->state[k] = TREE_MISSING;
+			}
+			fclose(t->files[f]);
+			t->files[f] = NULL;
+			t->maps[f] = NULL;
+			continue;
+		}
+		madvise(t->maps[f], t->map_sizes[f], MADV_SEQUENTIAL);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+}
+
+static void tree_init(prod_tree *t, mpz_t * array, size_t from, size_t to,
+const size_t *bits, const copri_modulus *root) {
+	size_t n = 2 * (to - from) + 1, bytes;
+
+	memset(t, 0, sizeof(prod_tree));
+	t->node = (mpz_t *)malloc(n * sizeof(mpz_t));
+	t->state = (unsigned char *)calloc(n, 1);
+	t->array = array;
+	t->bits = bits;
+	t->step = tree_budget_step(array, from, to, &bytes);
+	if (tree_memory > 0) {
+		t->disk = tree_dir != NULL && bytes > tree_memory;
+	} else {
+		t->step = tree_step;
+		t->disk = tree_dir != NULL && bytes >= tree_disk_bytes;
+	}
+	if (t->disk) {
+		t->file = (unsigned char *)malloc(n);
+		t->offset = (off_t *)malloc(n * sizeof(off_t));
+	}
+	tree_build(t, 0, from, to, 0, root);
+	tree_retire(t, 0, 0);
+	if (t->disk)
+		tree_map(t, n);
+}
+
+static void tree_clear(prod_tree *t, size_t from, size_t to) {
+	size_t k, f;
+
+	for (k = 0; k < 2 * (to - from) + 1; k++) {
+		if (t->state[k] == TREE_KEPT || t->state[k] == TREE_TEMPORARY ||
+		t->state[k] == TREE_LOADED)
+			mpz_clear(t->node[k]);
+	}
+	for (f = 0; f < TREE_MAX_FILES; f++) {
+		if (t->maps[f] != NULL)
+			munmap(t->maps[f], t->map_sizes[f]);
+		if (t->files[f] != NULL)
+			fclose(t->files[f]);
+	}
+	free(t->node);
+	free(t->state);
+	free(t->file);
+	free(t->offset);
+}
+
+
+// ### Product of skewed operands
+
+// Compute the product of `array[from..to]` like `prod`, but always
+// multiply the two smallest pending operands (by limb count). If the
+// sizes of the integers differ a lot, e.g. the elements of a coprime base,
+// this avoids multiplications of a big and a tiny operand. For integers of
+// equal size the result is a balanced product tree.
+//
+// The pending operands are kept in a binary min heap. The leaves point
+// into `array`, the inner products are taken from the `pool`.
+//
+// See [huffman test](test-huffman.html) for basic usage.
+static int huffman_less(mpz_ptr *heap, size_t a, size_t b) {
+	return mpz_size(heap[a]) < mpz_size(heap[b]);
+}
+
+static void huffman_down(mpz_ptr *heap, size_t used, size_t i) {
+	size_t c;
+	mpz_ptr t;
+
+	while ((c = 2 * i + 1) < used) {
+		if (c + 1 < used && huffman_less(heap, c + 1, c))
+			c++;
+		if (!huffman_less(heap, c, i))
+			break;
+		t = heap[i]; heap[i] = heap[c]; heap[c] = t;
+		i = c;
+	}
+}
+
+void huffman_prod(mpz_pool *pool, mpz_ptr rot, mpz_t * array,
+size_t from, size_t to) {
+	size_t i, k = 0, used = to - from + 1;
+	mpz_ptr *heap, a, b;
+	mpz_t *nodes;
+
+	if (used < 3) {
+		prod(pool, rot, array, from, to);
+		return;
+	}
+
+	heap = (mpz_ptr *)malloc(used * sizeof(mpz_ptr));
+	nodes = (mpz_t *)malloc((used - 1) * sizeof(mpz_t));
+	for (i = 0; i < used; i++) {
+		heap[i] = array[from + i];
+	}
+	for (i = used / 2; i-- > 0;) {
+		huffman_down(heap, used, i);
+	}
+
+	while (used > 1) {
+		// Take the two smallest operands.
+		a = heap[0];
+		heap[0] = heap[--used];
+		huffman_down(heap, used, 0);
+		b = heap[0];
+
+		// Replace them by their product.
+		pool_pop(pool, nodes[k]);
+		parallel_mul(nodes[k], a, b);
+		heap[0] = nodes[k];
+		huffman_down(heap, used, 0);
+
+		// Inner products are not needed any more.
+		if (a >= nodes[0] && a < nodes[k])
+			pool_push(pool, a);
+		if (b >= nodes[0] && b < nodes[k])
+			pool_push(pool, b);
+		k++;
+	}
+
+	mpz_swap(rot, heap[0]);
+	pool_push(pool, heap[0]);
+	free(heap);
+	free(nodes);
+}
+
+// #### array verison
+void array_huffman_prod(mpz_pool *pool, mpz_array *a, mpz_ptr rot) {
+	if (a->used > 0)
+		huffman_prod(pool, rot, a->array, 0, a->used-1);
+	else {
+		mpz_set_ui(rot, 1);
+	}
+}
+
+
 // ### fast algorithm to compute split(a,P).
 
 // This function expects initialized mpz integers in all array fields between `from` and `to`.
@@ -301,19 +1221,24 @@ void array_prod(mpz_pool *pool, mpz_array *a, mpz_t rot) {
 // Algorithm 15.3 [PDF page 20](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [split test](test-split.html) for basic usage.
-void split(mpz_pool *pool, mpz_array *ret, const mpz_t a,
-mpz_t *p, size_t from, size_t to) {
-	mpz_t b, x;
-	size_t n = to - from;
+//
+// The products of P are taken from the product `tree`. If the caller has
+// already computed prod P, it is passed as the prepared modulus `root`.
+static void split_rec(mpz_pool *pool, mpz_array *ret, const mpz_t a,
+prod_tree *tree, size_t k, size_t from, size_t to, const size_t *bits,
+const copri_modulus *root) {
+	mpz_t b;
+	size_t n = to - from, m;
 
 	// **Sep 2**
 	//
 	//  Compute b ← ppi(a,prodP)
-	pool_pop(pool, x);
 	pool_pop(pool, b);
-	prod(pool, x, p, from, to);
-	ppi(pool, b, a, x);
-	pool_push(pool, x);
+	if (root != NULL) {
+		modulus_ppi(pool, b, a, root);
+	} else {
+		ppi(pool, b, a, tree_get(tree, k, from, to));
+	}
 
 	// **Sep 2**
 	//
@@ -327,13 +1252,26 @@ mpz_t *p, size_t from, size_t to) {
 	// **Sep 3**
 	//
 	//  Select Q ⊆ P with #Q = b#P/2c.
-	split(pool, ret, b, p, from, to - n/2 - 1);
-	split(pool, ret, b, p, to - n/2, to);
+	m = split_at(bits, from, to);
+	split_rec(pool, ret, b, tree, k + 1, from, m, bits, NULL);
+	split_rec(pool, ret, b, tree, k + tree_right(from, m), m + 1, to, bits, NULL);
+	tree_put(tree, k, from, to);
 
 	// Free the memory.
 	pool_push(pool, b);
 }
 
+void split(mpz_pool *pool, mpz_array *ret, const mpz_t a,
+mpz_t *p, size_t from, size_t to) {
+	size_t *bits = split_bits(p, from, to);
+	prod_tree tree;
+
+	tree_init(&tree, p, from, to, bits, NULL);
+	split_rec(pool, ret, a, &tree, 0, from, to, bits, NULL);
+	tree_clear(&tree, from, to);
+	free(bits);
+}
+
 // #### array verison
 void array_split(mpz_pool *pool, mpz_array *ret,
 const mpz_t a, mpz_array *p) {
@@ -343,6 +1281,23 @@ const mpz_t a, mpz_array *p) {
 		fprintf(stderr, "array_split on empty array\n");
 }
 
+// Like `array_split` with prod P prepared as `root`.
+static void array_split_prepared(mpz_pool *pool, mpz_array *ret,
+const mpz_t a, mpz_array *p, const copri_modulus *root) {
+	size_t *bits;
+	prod_tree tree;
+
+	if (p->used == 0) {
+		fprintf(stderr, "array_split on empty array\n");
+		return;
+	}
+	bits = split_bits(p->array, 0, p->used-1);
+	tree_init(&tree, p->array, 0, p->used-1, bits, root);
+	split_rec(pool, ret, a, &tree, 0, 0, p->used-1, bits, root);
+	tree_clear(&tree, 0, p->used-1);
+	free(bits);
+}
+
 
 // ### Extending a coprime base
 
@@ -356,6 +1311,7 @@ const mpz_t b) {
 	size_t i;
 	mpz_t x, a, r;
 	mpz_array s;
+	copri_modulus xm;
 
 	// **Sep 1**
 	//
@@ -369,15 +1325,20 @@ const mpz_t b) {
 	// **Sep 2**
 	//
 	//  Compute x ← prod P
+	//
+	// The elements of a coprime base differ a lot in size.
+	//
+	// x is prepared once for the ppi_ppo and the root of the split.
 	pool_pop(pool, x);
-	array_prod(pool, p, x);
+	array_huffman_prod(pool, p, x);
+	modulus_init(&xm, x);
 
 	// **Sep 3**
 	//
 	//   Compute (a,r) ← (ppi,ppo)(b, x) b
 	pool_pop(pool, a);
 	pool_pop(pool, r);
-	ppi_ppo(pool, a, r, b, x);
+	modulus_ppi_ppo(pool, a, r, b, &xm);
 
 	// **Sep 4**
 	//
@@ -390,7 +1351,7 @@ const mpz_t b) {
 	//
 	//   Compute S ← split(a,P)
 	array_init(&s, p->used);
-	array_split(pool, &s, a, p);
+	array_split_prepared(pool, &s, a, p, &xm);
 
 	// **Sep 6**
 	//
@@ -405,6 +1366,7 @@ const mpz_t b) {
 
 	// Free the memory.
 	array_clear(&s);
+	modulus_clear(&xm);
 	pool_push(pool, a);
 	pool_push(pool, r);
 	pool_push(pool, x);
@@ -420,20 +1382,431 @@ int bit(size_t i, size_t k) {
 }
 
 
+// ### Checkpoints
+
+// A long `cb` run can store its progress in a checkpoint directory. The
+// coprime base of a finished subtree `from..to` is stored in
+// `cb-FROM-TO.gmp`, a running `cbmerge` in `merge-FROM-TO.gmp` (the
+// iteration i, the phase, the counts of Q and of S or T, Q and S or T,
+// so a truncated file is noticed). The file
+// `keys.gmp` identifies the input. All files use the raw gmp format.
+//
+// A checkpoint is taken if `interval` seconds passed since the last one.
+// The integers are copied and written by a background thread, no new
+// checkpoint is taken until it is done. A file is renamed into place after
+// it is written and then the checkpoints it replaces are removed, so a
+// killed run always leaves a usable directory.
+//
+// With `copri_set_resume` a run with the same input and settings loads
+// the stored results instead of computing them, otherwise the directory
+// is cleared.
+typedef struct checkpoint_job {
+	char name[64];
+	mpz_array a;
+	size_t from;
+	size_t to;
+	int prune;
+	struct checkpoint_job *next;
+} checkpoint_job;
+
+// A checkpoint file found in the directory when a run is resumed.
+typedef struct {
+	char kind[8];
+	size_t from;
+	size_t to;
+} checkpoint_file;
+
+static const char *checkpoint_dir = NULL;
+static double checkpoint_interval = 300;
+static int checkpoint_resume = 0;
+static int checkpoint_active = 0;
+static double checkpoint_last = 0;
+static int checkpoint_busy = 0;
+static checkpoint_job *checkpoint_queue = NULL;
+static checkpoint_file *checkpoint_files = NULL;
+static size_t checkpoint_nfiles = 0;
+static pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpoint_idle = PTHREAD_COND_INITIALIZER;
+
+void copri_set_checkpoint(const char *dir, double interval) {
+	checkpoint_dir = dir;
+	checkpoint_interval = interval;
+}
+
+const char *copri_get_checkpoint_dir() {
+	return checkpoint_dir;
+}
+
+double copri_get_checkpoint_interval() {
+	return checkpoint_interval;
+}
+
+void copri_set_resume(int resume) {
+	checkpoint_resume = resume;
+}
+
+int copri_get_resume() {
+	return checkpoint_resume;
+}
+
+static double checkpoint_now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static char *checkpoint_path(const char *name, const char *suffix) {
+	char *path = (char *)malloc(strlen(checkpoint_dir) + strlen(name) + strlen(suffix) + 2);
+	sprintf(path, "%s/%s%s", checkpoint_dir, name, suffix);
+	return path;
+}
+
+// Removes the checkpoints of the subtrees strictly inside `from..to`. A
+// `cb` file also replaces the merge of its own subtree.
+static void checkpoint_prune(size_t from, size_t to, int cb) {
+	DIR *dir;
+	struct dirent *e;
+	char kind[8], *path;
+	size_t f, t;
+
+	dir = opendir(checkpoint_dir);
+	if (dir == NULL)
+		return;
+	while ((e = readdir(dir)) != NULL) {
+		if (sscanf(e->d_name, "%7[a-z]-%zu-%zu.gmp", kind, &f, &t) != 3)
+			continue;
+		if (f < from || t > to || (f == from && t == to && (!cb || strcmp(kind, "cb") == 0)))
+			continue;
+		path = checkpoint_path(e->d_name, "");
+		unlink(path);
+		free(path);
+	}
+	closedir(dir);
+}
+
+static int checkpoint_file_cmp(const void *a, const void *b) {
+	const checkpoint_file *x = (const checkpoint_file *)a;
+	const checkpoint_file *y = (const checkpoint_file *)b;
+	int r = strcmp(x->kind, y->kind);
+
+	if (r != 0)
+		return r;
+	if (x->from != y->from)
+		return x->from < y->from ? -1 : 1;
+	if (x->to != y->to)
+		return x->to < y->to ? -1 : 1;
+	return 0;
+}
+
+// Lists the checkpoints of the directory once, a resumed `cb` only opens
+// the files of the subtrees in this list instead of trying every node.
+static void checkpoint_scan() {
+	DIR *dir;
+	struct dirent *e;
+	checkpoint_file f;
+	size_t size = 0;
+
+	checkpoint_nfiles = 0;
+	dir = opendir(checkpoint_dir);
+	if (dir == NULL)
+		return;
+	while ((e = readdir(dir)) != NULL) {
+		if (sscanf(e->d_name, "%7[a-z]-%zu-%zu.gmp", f.kind, &f.from, &f.to) != 3)
+			continue;
+		if (checkpoint_nfiles == size) {
+			size = size ? size * 2 : 16;
+			checkpoint_files = (checkpoint_file *)realloc(checkpoint_files,
+				size * sizeof(checkpoint_file));
+		}
+		checkpoint_files[checkpoint_nfiles++] = f;
+	}
+	closedir(dir);
+	qsort(checkpoint_files, checkpoint_nfiles, sizeof(checkpoint_file),
+		checkpoint_file_cmp);
+}
+
+// Returns 1 if the scan found the checkpoint `kind` of `from..to`.
+static int checkpoint_found(const char *kind, size_t from, size_t to) {
+	checkpoint_file f;
+
+	snprintf(f.kind, sizeof(f.kind), "%s", kind);
+	f.from = from;
+	f.to = to;
+	return bsearch(&f, checkpoint_files, checkpoint_nfiles,
+		sizeof(checkpoint_file), checkpoint_file_cmp) != NULL;
+}
+
+static int checkpoint_write(const char *name, mpz_array *a) {
+	char *path = checkpoint_path(name, ""), *tmp = checkpoint_path(name, ".tmp");
+	FILE *out;
+	int ok = 0;
+
+	out = fopen(tmp, "w");
+	if (out != NULL) {
+		ok = array_to_stdio(a, out) == a->used && fflush(out) == 0 &&
+			fsync(fileno(out)) == 0;
+		ok = fclose(out) == 0 && ok && rename(tmp, path) == 0;
+	}
+	if (!ok) {
+		fprintf(stderr, "Can't write the checkpoint %s\n", path);
+		unlink(tmp);
+	}
+	free(path);
+	free(tmp);
+	return ok;
+}
+
+// The background thread writes the queued checkpoints in order.
+static void *checkpoint_writer(void *arg) {
+	checkpoint_job *job;
+
+	pthread_mutex_lock(&checkpoint_lock);
+	while ((job = checkpoint_queue) != NULL) {
+		pthread_mutex_unlock(&checkpoint_lock);
+		if (checkpoint_write(job->name, &job->a) && job->prune)
+			checkpoint_prune(job->from, job->to, job->name[0] == 'c');
+		array_clear(&job->a);
+		pthread_mutex_lock(&checkpoint_lock);
+		checkpoint_queue = job->next;
+		free(job);
+	}
+	checkpoint_busy = 0;
+	pthread_cond_broadcast(&checkpoint_idle);
+	pthread_mutex_unlock(&checkpoint_lock);
+	return NULL;
+}
+
+// Returns 1 if the next checkpoint should be taken now.
+static int checkpoint_due() {
+	int due;
+
+	if (!checkpoint_active)
+		return 0;
+	pthread_mutex_lock(&checkpoint_lock);
+	due = !checkpoint_busy && checkpoint_now() - checkpoint_last >= checkpoint_interval;
+	if (due)
+		checkpoint_busy = 1;
+	pthread_mutex_unlock(&checkpoint_lock);
+	return due;
+}
+
+// Returns a job with a copy of `header` and `a[start..]`.
+static checkpoint_job *checkpoint_job_new(const char *kind, size_t from,
+size_t to, const unsigned long *header, size_t h, mpz_array *a, size_t start) {
+	checkpoint_job *job = (checkpoint_job *)malloc(sizeof(checkpoint_job));
+	mpz_t x;
+	size_t i;
+
+	// `cbmerge` replaces the whole content of its output.
+	if (start > a->used)
+		start = 0;
+	snprintf(job->name, sizeof(job->name), "%s-%zu-%zu.gmp", kind, from, to);
+	array_init(&job->a, a->used - start + h + 1);
+	mpz_init(x);
+	for (i = 0; i < h; i++) {
+		mpz_set_ui(x, header[i]);
+		array_add(&job->a, x);
+	}
+	mpz_clear(x);
+	for (i = start; i < a->used; i++) {
+		array_add(&job->a, a->array[i]);
+	}
+	job->from = from;
+	job->to = to;
+	job->prune = 1;
+	job->next = NULL;
+	return job;
+}
+
+// Hands the jobs to a new writer thread, `checkpoint_due` has marked it
+// busy. Without a thread the jobs are written at once.
+static void checkpoint_start(checkpoint_job *jobs) {
+	pthread_t thread;
+
+	pthread_mutex_lock(&checkpoint_lock);
+	checkpoint_queue = jobs;
+	checkpoint_last = checkpoint_now();
+	pthread_mutex_unlock(&checkpoint_lock);
+	if (pthread_create(&thread, NULL, checkpoint_writer, NULL) == 0)
+		pthread_detach(thread);
+	else
+		checkpoint_writer(NULL);
+}
+
+static void checkpoint_wait() {
+	pthread_mutex_lock(&checkpoint_lock);
+	while (checkpoint_busy)
+		pthread_cond_wait(&checkpoint_idle, &checkpoint_lock);
+	pthread_mutex_unlock(&checkpoint_lock);
+}
+
+// Appends the integers of a checkpoint to `a`, returns 0 if it does not
+// exist. Only the checkpoints found by `checkpoint_scan` are opened, a
+// file which was pruned since is missing too.
+static int checkpoint_load(mpz_array *a, const char *kind, size_t from, size_t to) {
+	char name[64], *path;
+	FILE *in;
+
+	if (!checkpoint_found(kind, from, to))
+		return 0;
+	snprintf(name, sizeof(name), "%s-%zu-%zu.gmp", kind, from, to);
+	path = checkpoint_path(name, "");
+	in = fopen(path, "r");
+	free(path);
+	if (in == NULL)
+		return 0;
+	array_of_stdio(a, in);
+	fclose(in);
+	return 1;
+}
+
+// Stores the coprime base `a[start..]` of `from..to` if a checkpoint is
+// due.
+static void checkpoint_cb(mpz_array *a, size_t start, size_t from, size_t to) {
+	if (checkpoint_due())
+		checkpoint_start(checkpoint_job_new("cb", from, to, NULL, 0, a, start));
+}
+
+// Stores the state of the merge of `from..to` if a checkpoint is due. Q
+// is part of the same file, so a merge is only resumed with the Q it
+// belongs to.
+static void checkpoint_merge(mpz_array *q, size_t from, size_t to,
+size_t i, int phase, mpz_array *a) {
+	unsigned long header[4];
+	checkpoint_job *job;
+
+	if (!checkpoint_due())
+		return;
+	header[0] = i;
+	header[1] = phase;
+	header[2] = q->used;
+	header[3] = a->used;
+	job = checkpoint_job_new("merge", from, to, header, 4, q, 0);
+	array_add_array(&job->a, a);
+	checkpoint_start(job);
+}
+
+// Loads the state of the merge of `from..to` into `q` and `a`, returns 0
+// if there is no complete state.
+static int checkpoint_load_merge(mpz_array *q, mpz_array *a, size_t *i,
+int *phase, size_t from, size_t to) {
+	mpz_array state;
+	size_t k, n = 0;
+	int ok;
+
+	array_init(&state, 16);
+	ok = checkpoint_load(&state, "merge", from, to) && state.used >= 4 &&
+		mpz_cmp_ui(state.array[1], 1) <= 0 && mpz_fits_ulong_p(state.array[2]) &&
+		mpz_fits_ulong_p(state.array[3]);
+	if (ok) {
+		n = mpz_get_ui(state.array[2]);
+		ok = n > 0 && mpz_cmp_ui(state.array[3], 0) > 0 &&
+			state.used - 4 - n == mpz_get_ui(state.array[3]) && n <= state.used - 4;
+	}
+	if (!ok) {
+		array_clear(&state);
+		return 0;
+	}
+	*i = mpz_get_ui(state.array[0]);
+	*phase = mpz_get_ui(state.array[1]);
+	for (k = 4; k < 4 + n; k++) {
+		array_add(q, state.array[k]);
+	}
+	for (; k < state.used; k++) {
+		array_add(a, state.array[k]);
+	}
+	array_clear(&state);
+	return 1;
+}
+
+// Starts the checkpoints of `cb(s[from..to])`. The input is identified by
+// its count, the leaf size, the split strategy and a hash of the keys.
+static void checkpoint_begin(mpz_t *s, size_t from, size_t to) {
+	mpz_array stamp, old;
+	mpz_t x;
+	uint64_t h = 14695981039346656037ULL;
+	const mp_limb_t *limbs;
+	size_t i, j;
+	char *path;
+
+	for (i = from; i <= to; i++) {
+		limbs = mpz_limbs_read(s[i]);
+		for (j = 0; j < mpz_size(s[i]); j++) {
+			h = (h ^ limbs[j]) * 1099511628211ULL;
+		}
+		h = (h ^ mpz_size(s[i])) * 1099511628211ULL;
+	}
+	array_init(&stamp, 4);
+	mpz_init_set_ui(x, to - from + 1);
+	array_add(&stamp, x);
+	mpz_set_ui(x, leaf_size);
+	array_add(&stamp, x);
+	mpz_set_ui(x, split_strategy);
+	array_add(&stamp, x);
+	mpz_import(x, 1, 1, sizeof(h), 0, 0, &h);
+	array_add(&stamp, x);
+	mpz_clear(x);
+
+	array_init(&old, 4);
+	path = checkpoint_path("keys.gmp", "");
+	if (checkpoint_resume && !(array_of_file(&old, path) > 0 && array_equal(&old, &stamp))) {
+		fprintf(stderr, "No checkpoint of these keys in %s, starting over\n", checkpoint_dir);
+		checkpoint_resume = 0;
+	}
+	if (!checkpoint_resume) {
+		checkpoint_prune(0, SIZE_MAX, 1);
+		unlink(path);
+		checkpoint_write("keys.gmp", &stamp);
+	} else {
+		checkpoint_scan();
+	}
+	free(path);
+	array_clear(&old);
+	array_clear(&stamp);
+
+	checkpoint_last = checkpoint_now();
+	checkpoint_active = 1;
+}
+
+// Stores the coprime base of the whole input and waits for the writer.
+static void checkpoint_end(mpz_array *a, size_t start, size_t from, size_t to) {
+	char name[64], *path;
+	checkpoint_job *job;
+
+	checkpoint_wait();
+	snprintf(name, sizeof(name), "cb-%zu-%zu.gmp", from, to);
+	path = checkpoint_path(name, "");
+	if (access(path, F_OK) != 0) {
+		job = checkpoint_job_new("cb", from, to, NULL, 0, a, start);
+		if (checkpoint_write(job->name, &job->a))
+			checkpoint_prune(from, to, 1);
+		array_clear(&job->a);
+		free(job);
+	}
+	free(path);
+	free(checkpoint_files);
+	checkpoint_files = NULL;
+	checkpoint_nfiles = 0;
+	checkpoint_active = 0;
+}
+
+
 // ### Merging coprime bases
 
 // This algorithm finds cb(P ∪ Q) if P is coprime and Q is coprime
 //
 // Algorithm 17.3  [PDF page 23](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
-// See [cbmerge test](test-cbmerge.html) for basic usage.
-void cbmerge(mpz_pool *pool, mpz_array *s, mpz_array *p,
-mpz_array *q) {
+// Within `cb` the merge of the subtree `from..to` stores its state after
+// every `cbextend` if a checkpoint is due. A resumed merge starts at the
+// iteration `i`, `p` is T if the first half of the iteration is done
+// (`phase` 1).
+static void cbmerge_at(mpz_pool *pool, mpz_array *s, mpz_array *p,
+mpz_array *q, size_t from, size_t to, int checkpoint, size_t i, int phase) {
 	mpz_array t; // T
 	mpz_array r; // buffer for q_k : bit_i k = 0 and q_k : bit_i k = 1
 	size_t n = q->used;
 	size_t b = 0;
-	size_t i = 0;
 	size_t k = 0;
 	mpz_t x; // buffer
 	pool_pop(pool, x);
@@ -444,8 +1817,13 @@ mpz_array *q) {
 		mpz_ui_pow_ui(x, 2, b);
 	} while(mpz_cmp_ui(x, n) < 0);
 
-	// Set S ← P.
-	array_add_array(s, p);
+	if (phase == 0) {
+		// Set S ← P.
+		array_add_array(s, p);
+	} else {
+		array_init(&t, p->used);
+		array_add_array(&t, p);
+	}
 
 	while(1) {
 		// If i = b: Print S. Stop.
@@ -453,28 +1831,33 @@ mpz_array *q) {
 			pool_push(pool, x);
 			return;
 		}
-		// Find R ← {qk : bit(k) = 1}
-		array_init(&r, n);
-		for(k=0; k<n; k++) {
-			if (!bit(i,k)) array_add(&r, q->array[k]);
-		}
+		if (phase == 0) {
+			// Find R ← {qk : bit(k) = 1}
+			array_init(&r, n);
+			for(k=0; k<n; k++) {
+				if (!bit(i,k)) array_add(&r, q->array[k]);
+			}
 
-		// Compute x ← prod{R}
-		array_prod(pool, &r, x);
+			// Compute x ← prod{R}
+			array_huffman_prod(pool, &r, x);
+			array_clear(&r);
 
-		// Compute T ← cbextend(S ∪ {x})
-		array_init(&t, s->size);
-		cbextend(pool, &t, s, x);
+			// Compute T ← cbextend(S ∪ {x})
+			array_init(&t, s->size);
+			cbextend(pool, &t, s, x);
+			if (checkpoint)
+				checkpoint_merge(q, from, to, i, 1, &t);
+		}
+		phase = 0;
 
 		// Find R ← {qk : bit(k) = 1}
-		array_clear(&r);
 		array_init(&r, n);
 		for(k=0; k<n; k++) {
 			if (bit(i,k)) array_add(&r, q->array[k]);
 		}
 
 		// Compute x ← prod{R}
-		array_prod(pool, &r, x);
+		array_huffman_prod(pool, &r, x);
 
 		// Compute S ← cbextend(T ∪ {x})
 		array_clear(s);
@@ -485,7 +1868,144 @@ mpz_array *q) {
 		array_clear(&r);
 		array_clear(&t);
 		i++;
+		if (checkpoint)
+			checkpoint_merge(q, from, to, i, 0, s);
+	}
+}
+
+// See [cbmerge test](test-cbmerge.html) for basic usage.
+void cbmerge(mpz_pool *pool, mpz_array *s, mpz_array *p,
+mpz_array *q) {
+	cbmerge_at(pool, s, p, q, 0, 0, 0, 0, 0);
+}
+
+// A coprime base in the merge tree of `cbmerge_tree`, `merged` is set if
+// it is not one of the input bases and can be freed after the next merge.
+typedef struct {
+	mpz_array *base;
+	unsigned long long bits;
+	int merged;
+} merge_node;
+
+static int merge_node_cmp(const void *a, const void *b) {
+	const merge_node *x = (const merge_node *)a, *y = (const merge_node *)b;
+	return (x->bits > y->bits) - (x->bits < y->bits);
+}
+
+// Merges the base of `b` into `a` with a pool of its own, so the merges of
+// a round can run in parallel. `cbmerge` loops over the bits of the index
+// of Q, so the base with fewer elements is Q.
+static void merge_pair(merge_node *a, merge_node *b) {
+	mpz_array *r = (mpz_array *)malloc(sizeof(mpz_array));
+	mpz_pool pool;
+
+	pool_init(&pool, 0);
+	array_init(r, a->base->used + b->base->used);
+	if (a->base->used < b->base->used)
+		cbmerge(&pool, r, b->base, a->base);
+	else
+		cbmerge(&pool, r, a->base, b->base);
+	pool_clear(&pool);
+	if (a->merged) {
+		array_clear(a->base);
+		free(a->base);
+	}
+	if (b->merged) {
+		array_clear(b->base);
+		free(b->base);
+	}
+	a->base = r;
+	a->bits += b->bits;
+	a->merged = 1;
+}
+
+// Merges the `count` coprime bases of `s` into `ret` like the merge tree of
+// the `balanced-split` manifest: every round sorts the bases by their bit
+// length and pairs the two smallest, the next two and so on, an odd base
+// is carried to the next round. The merges of a round are independent
+// and run in parallel, the biggest ones are started first. The last
+// round is a single merge, which uses the parallel multiplication
+// instead. `s` is not changed.
+//
+// See [cbmerge test](test-cbmerge.html) for basic usage.
+void cbmerge_tree(mpz_array *ret, mpz_array *s, size_t count) {
+	merge_node *nodes;
+	size_t i, j, n, pairs;
+
+	if (count == 0)
+		return;
+	nodes = (merge_node *)malloc(count * sizeof(merge_node));
+	for (i = 0; i < count; i++) {
+		nodes[i].base = &s[i];
+		nodes[i].bits = 0;
+		nodes[i].merged = 0;
+		for (j = 0; j < s[i].used; j++)
+			nodes[i].bits += mpz_sizeinbase(s[i].array[j], 2);
+	}
+	for (n = count; n > 1; n = (n + 1) / 2) {
+		qsort(nodes, n, sizeof(merge_node), merge_node_cmp);
+		pairs = n / 2;
+#if USE_OPENMP
+#pragma omp parallel for schedule(dynamic) if(pairs > 1)
+#endif
+		for (i = 0; i < pairs; i++)
+			merge_pair(&nodes[2 * (pairs - 1 - i)], &nodes[2 * (pairs - 1 - i) + 1]);
+		for (i = 0; i < pairs; i++)
+			nodes[i] = nodes[2 * i];
+		if (n % 2 == 1)
+			nodes[pairs] = nodes[n - 1];
 	}
+	array_add_array(ret, nodes[0].base);
+	if (nodes[0].merged) {
+		array_clear(nodes[0].base);
+		free(nodes[0].base);
+	}
+	free(nodes);
+}
+
+// ### Coprime base of a small set
+
+// Computes cb(S) for `s[from..to]` directly. Every integer `b` extends the
+// coprime base P like `cbextend`, but the parts of `b` are computed by one
+// ppi and ppo per element of P instead of product trees.
+static void cb_leaf(mpz_pool *pool, mpz_array *ret, mpz_t *s,
+size_t from, size_t to) {
+	mpz_array p, t;
+	mpz_t c, r, r2;
+	size_t i, j;
+
+	pool_pop(pool, c);
+	pool_pop(pool, r);
+	pool_pop(pool, r2);
+	array_init(&p, to - from + 1);
+	for (i = from; i <= to; i++) {
+		if (mpz_cmp_ui(s[i], 0) == 0) {
+			fprintf(stderr, "warning adding 0 in cb\n");
+			continue;
+		}
+		if (mpz_cmp_ui(s[i], 1) == 0)
+			continue;
+
+		// For each p ∈ P: Apply append_cb(p, ppi(b, p)). Print the
+		// remaining part of b if it is not 1.
+		array_init(&t, 2 * p.used + 1);
+		mpz_set(r, s[i]);
+		for (j = 0; j < p.used; j++) {
+			ppi_ppo(pool, c, r2, r, p.array[j]);
+			mpz_swap(r, r2);
+			append_cb(pool, &t, p.array[j], c);
+		}
+		if (mpz_cmp_ui(r, 1) != 0)
+			array_add(&t, r);
+		array_clear(&p);
+		p = t;
+	}
+	array_add_array(ret, &p);
+
+	array_clear(&p);
+	pool_push(pool, c);
+	pool_push(pool, r);
+	pool_push(pool, r2);
 }
 
 // ### Computing a coprime base for a finite set
@@ -496,10 +2016,11 @@ mpz_array *q) {
 // Algorithm 18.1 [PDF page 24](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [cb test](test-cb.html) for basic usage.
-void cb(mpz_pool *pool, mpz_array *ret, mpz_t *s,
-size_t from, size_t to) {
-	size_t n = to - from;
+static void cb_rec(mpz_pool *pool, mpz_array *ret, mpz_t *s,
+size_t from, size_t to, const size_t *bits) {
+	size_t n = to - from, m, start = ret->used, i;
 	mpz_array p, q;
+	int phase;
 #if USE_OPENMP
 	mpz_pool pool_p, pool_q;
 #endif
@@ -515,6 +2036,28 @@ size_t from, size_t to) {
 		}
 		return;
 	}
+	if (n < leaf_size) {
+		cb_leaf(pool, ret, s, from, to);
+		return;
+	}
+
+	// Continue from the checkpoint of this subtree.
+	if (checkpoint_active && checkpoint_resume) {
+		if (checkpoint_load(ret, "cb", from, to))
+			return;
+		// Without a complete merge state the subtree is computed again.
+		array_init(&p, n);
+		array_init(&q, n);
+		if (checkpoint_load_merge(&q, &p, &i, &phase, from, to)) {
+			cbmerge_at(pool, ret, &p, &q, from, to, 1, i, phase);
+			array_clear(&p);
+			array_clear(&q);
+			checkpoint_cb(ret, start, from, to);
+			return;
+		}
+		array_clear(&p);
+		array_clear(&q);
+	}
 
 // ## OpenMP multithreading
 // Execute both recrusive `cb` calls in parallel.
@@ -522,6 +2065,7 @@ size_t from, size_t to) {
 // `export OMP_NUM_THREADS=4` to set the maximal thread number.
 	array_init(&p, n);
 	array_init(&q, n);
+	m = split_at(bits, from, to);
 #if USE_OPENMP
 	const int parent = omp_get_thread_num();
 #pragma omp parallel sections
@@ -532,10 +2076,10 @@ size_t from, size_t to) {
 	if (id != parent) {
 		/* printf("New thread\n"); */
 		pool_init(&pool_p, 0);
-		cb(&pool_p, &p, s, from, to - n/2 - 1);
+		cb_rec(&pool_p, &p, s, from, m, bits);
 		pool_clear(&pool_p);
 	} else {
-		cb(pool, &p, s, from, to - n/2 - 1);
+		cb_rec(pool, &p, s, from, m, bits);
 	}
  }
  #pragma omp section
@@ -544,20 +2088,20 @@ size_t from, size_t to) {
 	if (id != parent) {
 		/* printf("New thread\n"); */
 		pool_init(&pool_q, 0);
-		cb(&pool_q, &q, s, to - n/2, to);
+		cb_rec(&pool_q, &q, s, m + 1, to, bits);
 		pool_clear(&pool_q);
 	} else {
-		cb(pool, &q, s, to - n/2, to);
+		cb_rec(pool, &q, s, m + 1, to, bits);
 	}
  }
 }
 #else
-	cb(pool, &p, s, from, to - n/2 - 1);
-	cb(pool, &q, s, to - n/2, to);
+	cb_rec(pool, &p, s, from, m, bits);
+	cb_rec(pool, &q, s, m + 1, to, bits);
 #endif
 	// Print cbmerge(P∪Q)
 	if (q.used && p.used) {
-		cbmerge(pool, ret, &p, &q);
+		cbmerge_at(pool, ret, &p, &q, from, to, checkpoint_active, 0, 0);
 	} else if(!q.used && p.used) {
 		array_add_array(ret, &p);
 		fprintf(stderr, "warning: q is empty in cb\n");
@@ -567,12 +2111,26 @@ size_t from, size_t to) {
 	} else {
 		fprintf(stderr, "warning: p an q are empty in cb\n");
 	}
+	if (checkpoint_active)
+		checkpoint_cb(ret, start, from, to);
 
 	// Free the memory.
 	array_clear(&p);
 	array_clear(&q);
 }
 
+void cb(mpz_pool *pool, mpz_array *ret, mpz_t *s,
+size_t from, size_t to) {
+	size_t *bits = split_bits(s, from, to), start = ret->used;
+
+	if (checkpoint_dir != NULL)
+		checkpoint_begin(s, from, to);
+	cb_rec(pool, ret, s, from, to, bits);
+	if (checkpoint_active)
+		checkpoint_end(ret, start, from, to);
+	free(bits);
+}
+
 // #### array verison
 void array_cb(mpz_pool *pool, mpz_array *ret, mpz_array *s) {
 	if (s->used > 0)
@@ -581,6 +2139,52 @@ void array_cb(mpz_pool *pool, mpz_array *ret, mpz_array *s) {
 		fprintf(stderr, "array_cb on empty array\n");
 }
 
+// ### Updating a coprime base
+
+// Computes cb(P ∪ S) for a coprime base P and new integers S. A merge
+// of cb(S) with `cbmerge` costs about 2 log #S calls of `cbextend`
+// (2 ⌈log2 #S⌉), so a small S is added by one `cbextend` per integer.
+// The integers of S have to be distinct like for `cb`.
+//
+// See [cbupdate test](test-cbupdate.html) for basic usage.
+void cbupdate(mpz_pool *pool, mpz_array *ret, mpz_array *p, mpz_array *s) {
+	mpz_array q, t;
+	size_t i, b = 1;
+
+	if (p->used == 0) {
+		array_cb(pool, ret, s);
+		return;
+	}
+	if (s->used == 0) {
+		array_add_array(ret, p);
+		return;
+	}
+	while (((size_t)1 << b) < s->used) {
+		b++;
+	}
+
+	if (s->used > 2 * b) {
+		array_init(&q, s->used);
+		array_cb(pool, &q, s);
+		cbmerge(pool, ret, p, &q);
+		array_clear(&q);
+		return;
+	}
+
+	array_init(&q, p->used + s->used);
+	array_add_array(&q, p);
+	for (i = 0; i < s->used; i++) {
+		if (mpz_cmp_ui(s->array[i], 1) <= 0)
+			continue;
+		array_init(&t, q.used + 2);
+		cbextend(pool, &t, &q, s->array[i]);
+		array_clear(&q);
+		q = t;
+	}
+	array_add_array(ret, &q);
+	array_clear(&q);
+}
+
 
 // ### The reduce function
 
@@ -595,9 +2199,11 @@ const mpz_t p, const mpz_t a) {
 	//
 	//  If p does not divide a: Print (0,a) and stop.
 	pool_pop(pool, r);
-	mpz_fdiv_r(r, a, p);
+	pool_pop(pool, a2);
+	parallel_fdiv_qr(a2, r, a, p);
 	if (mpz_cmp_ui(r, 0) != 0) {
 		pool_push(pool, r);
+		pool_push(pool, a2);
 		mpz_set_ui(i, 0);
 		mpz_set(pai, a);
 		return;
@@ -609,31 +2215,29 @@ const mpz_t p, const mpz_t a) {
 	pool_pop(pool, j);
 	pool_pop(pool, b);
 	pool_pop(pool, p2);
-	pool_pop(pool, a2);
-	mpz_mul(p2, p, p);
-	mpz_fdiv_q(a2, a, p);
+	parallel_mul(p2, p, p);
 	reduce(pool, j, b, p2, a2);
 	pool_push(pool, p2);
-	pool_push(pool, a2);
 
 	// **Sep 3**
 	//
 	//  If p divides b: Print (2 j +2,b/p) and stop.
-	mpz_fdiv_r(r, b, p);
+	parallel_fdiv_qr(a2, r, b, p);
 	if (mpz_cmp_ui(r, 0) == 0) {
 		mpz_mul_ui(j, j, 2);
 		mpz_add_ui(j, j, 2);
 		mpz_set(i, j);
 
-		mpz_fdiv_q(b, b, p);
-		mpz_set(pai, b);
+		mpz_set(pai, a2);
 
 		pool_push(pool, r);
+		pool_push(pool, a2);
 		pool_push(pool, b);
 		pool_push(pool, j);
 		return;
 	}
 	pool_push(pool, r);
+	pool_push(pool, a2);
 
 	// **Sep 4**
 	//
@@ -656,10 +2260,11 @@ const mpz_t p, const mpz_t a) {
 // Algorithm 20.1  [PDF page 25](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [findfactor test](test-findfactor.html) for basic usage.
-int find_factor(mpz_pool *pool, mpz_array *out, const mpz_t a0,
-const mpz_t a, mpz_t *p, size_t from, size_t to) {
+static int find_factor_rec(mpz_pool *pool, mpz_array *out, const mpz_t a0,
+const mpz_t a, mpz_t *p, prod_tree *tree, size_t k, size_t from, size_t to,
+const size_t *bits) {
 	mpz_t m, c, y, b, c2;
-	size_t n = to - from;
+	size_t n = to - from, h;
 	unsigned int r = 1;
 
 	// If #P = 1: Find p ∈ P. Compute (n, c) ← reduce(p,a) by Algorithm 19.2. If
@@ -687,32 +2292,45 @@ const mpz_t a, mpz_t *p, size_t from, size_t to) {
 	}
 	// Select Q ⊆ P with #Q = b#P/2c.
 
-	// Compute y ← prod Q
-	pool_pop(pool, y);
-	prod(pool, y, p, from, to - n/2 - 1);
+	// Compute y ← prod Q, it is the left child in the product tree.
+	h = split_at(bits, from, to);
 
 	// Compute (b, c) ← (ppi,ppo)(a, y)
 	pool_pop(pool, b);
 	pool_pop(pool, c2);
-	ppi_ppo(pool, b, c2, a, y);
+	ppi_ppo(pool, b, c2, a, tree_get(tree, k + 1, from, h));
 
 	// Apply Algorithm 20.1 to (b,Q) recursively. If Algorithm 20.1 fails, proclaim
 	// failure and stop.
-	if (!find_factor(pool, out, a0, b, p, from, to - n/2 - 1)) {
+	if (!find_factor_rec(pool, out, a0, b, p, tree, k + 1, from, h, bits)) {
 		r = 0;
 	// Apply Algorithm 20.1 to (c,P−Q) recursively. If Algorithm 20.1 fails, proclaim
 	// failure and stop.
-	} else if (!find_factor(pool, out, a0, c2, p, to - n/2, to)) {
+	} else if (!find_factor_rec(pool, out, a0, c2, p, tree,
+	k + tree_right(from, h), h + 1, to, bits)) {
 		r = 0;
 	}
 
 	// Free the memory.
-	pool_push(pool, y);
+	tree_put(tree, k + 1, from, h);
 	pool_push(pool, b);
 	pool_push(pool, c2);
 	return r;
 }
 
+int find_factor(mpz_pool *pool, mpz_array *out, const mpz_t a0,
+const mpz_t a, mpz_t *p, size_t from, size_t to) {
+	size_t *bits = split_bits(p, from, to);
+	prod_tree tree;
+	int r;
+
+	tree_init(&tree, p, from, to, bits, NULL);
+	r = find_factor_rec(pool, out, a0, a, p, &tree, 0, from, to, bits);
+	tree_clear(&tree, from, to);
+	free(bits);
+	return r;
+}
+
 // #### array verison
 int array_find_factor(mpz_pool *pool, mpz_array *out,
 const mpz_t a, mpz_array *p) {
@@ -725,6 +2343,43 @@ const mpz_t a, mpz_array *p) {
 }
 
 
+// ### Factoring a small set over a coprime base
+
+// Factors `s[from..to]` over `p` directly. Like `find_factor` only the
+// first element of P whose primes all divide `a` is used: if the part of
+// `a` with its primes is a power of it and it is not `a` itself, `a` is
+// printed with the factor and the cofactor.
+static void find_factors_leaf(mpz_pool *pool, mpz_array *out, mpz_t *s,
+size_t from, size_t to, mpz_array *p) {
+	mpz_t g, m, c;
+	size_t i, j;
+
+	pool_pop(pool, g);
+	pool_pop(pool, m);
+	pool_pop(pool, c);
+	for (i = from; i <= to; i++) {
+		for (j = 0; j < p->used; j++) {
+			ppi(pool, g, p->array[j], s[i]);
+			if (mpz_cmp(g, p->array[j]) == 0)
+				break;
+		}
+		if (j == p->used)
+			continue;
+
+		ppi(pool, g, s[i], p->array[j]);
+		reduce(pool, m, c, p->array[j], g);
+		if (mpz_cmp_ui(c, 1) == 0 && mpz_cmp(s[i], p->array[j]) != 0) {
+			mpz_fdiv_q(g, s[i], p->array[j]);
+			array_add(out, s[i]);
+			array_add(out, p->array[j]);
+			array_add(out, g);
+		}
+	}
+	pool_push(pool, g);
+	pool_push(pool, m);
+	pool_push(pool, c);
+}
+
 // ### Factoring a set over a coprime base
 
 // This algorithm factors each element a ∈ S over P if P is a base for S; otherwise it proclaims failure.
@@ -732,23 +2387,26 @@ const mpz_t a, mpz_array *p) {
 // Algorithm 21.2  [PDF page 27](http://cr.yp.to/lineartime/dcba-20040404.pdf)
 //
 // See [findfactors test](test-findfactors.html) for basic usage.
-void find_factors(mpz_pool *pool, mpz_array *out, mpz_t *s,
-size_t from, size_t to, mpz_array *p) {
-	mpz_t x, y, z;
+//
+// The products y of the subsets of S are taken from the product `tree`.
+static void find_factors_rec(mpz_pool *pool, mpz_array *out, mpz_t *s,
+prod_tree *tree, size_t k, size_t from, size_t to, mpz_array *p,
+const size_t *bits) {
+	mpz_t x, z;
 	mpz_array d, q;
-	size_t i, n = to - from;
+	size_t i, m, n = to - from;
+	copri_modulus xm;
 
 	pool_pop(pool, x);
 	array_prod(pool, p, x);
-
-	pool_pop(pool, y);
-	prod(pool, y, s, from, to);
+	modulus_init(&xm, x);
 
 	pool_pop(pool, z);
-	ppi(pool, z, x, y);
+	ppi(pool, z, x, tree_get(tree, k, from, to));
 
 	array_init(&d, p->size);
-	array_split(pool, &d, z, p);
+	array_split_prepared(pool, &d, z, p, &xm);
+	modulus_clear(&xm);
 
 	array_init(&q, p->size);
 	for (i = 0; i < p->used; i++) {
@@ -757,19 +2415,34 @@ size_t from, size_t to, mpz_array *p) {
 	}
 
 	if (n == 0) {
-		array_find_factor(pool, out, y, &q);
+		array_find_factor(pool, out, s[from], &q);
+	} else if (n < leaf_size) {
+		find_factors_leaf(pool, out, s, from, to, &q);
 	} else {
-		find_factors(pool, out, s, from, to - n/2 - 1, &q);
-		find_factors(pool, out, s, to - n/2, to, &q);
+		m = split_at(bits, from, to);
+		find_factors_rec(pool, out, s, tree, k + 1, from, m, &q, bits);
+		find_factors_rec(pool, out, s, tree, k + tree_right(from, m), m + 1, to,
+			&q, bits);
 	}
 
+	tree_put(tree, k, from, to);
 	pool_push(pool, x);
-	pool_push(pool, y);
 	pool_push(pool, z);
 	array_clear(&d);
 	array_clear(&q);
 }
 
+void find_factors(mpz_pool *pool, mpz_array *out, mpz_t *s,
+size_t from, size_t to, mpz_array *p) {
+	size_t *bits = split_bits(s, from, to);
+	prod_tree tree;
+
+	tree_init(&tree, s, from, to, bits, NULL);
+	find_factors_rec(pool, out, s, &tree, 0, from, to, p, bits);
+	tree_clear(&tree, from, to);
+	free(bits);
+}
+
 // #### array verison
 void array_find_factors(mpz_pool *pool, mpz_array *out,
 mpz_array *s, mpz_array *p) {
@@ -778,3 +2451,206 @@ mpz_array *s, mpz_array *p) {
 	else
 		fprintf(stderr, "array_printfactors_set on empty array\n");
 }
+
+
+// ### Querying a corpus
+
+// A corpus keeps the product tree of `array[0..count-1]` resident to test
+// single keys against it. The tree follows `copri_set_tree_step` and
+// `copri_set_tree_memory` like the trees of `find_factors`.
+//
+// `corpus_query` finds the keys which share a factor with `n`. If
+// gcd(n, prod mod n) = 1 the answer costs one reduction of the root.
+// Otherwise the common part g of a node and `n` is known and only the
+// children with gcd(g, prod mod g) != 1 are visited, so a single hit costs
+// about one more pass over the product and O(log n) steps. The tree is
+// only read (`tree_read`), missing nodes of a tree step above 1 and nodes
+// on disk are recomputed or loaded into temporaries, so queries can run
+// concurrently on every corpus tree.
+//
+// See [corpus test](test-corpus.html) for basic usage.
+void corpus_init(copri_corpus *c, mpz_t *array, size_t count) {
+	c->array = array;
+	c->count = count;
+	c->tree = NULL;
+	if (count == 0)
+		return;
+	c->tree = malloc(sizeof(prod_tree));
+	tree_init((prod_tree *)c->tree, array, 0, count - 1, NULL, NULL);
+}
+
+void corpus_clear(copri_corpus *c) {
+	if (c->tree == NULL)
+		return;
+	tree_clear((prod_tree *)c->tree, 0, c->count - 1);
+	free(c->tree);
+	c->tree = NULL;
+}
+
+// Sets `r` to the product of the corpus modulo `q`.
+void corpus_mod(mpz_t r, const copri_corpus *c, const mpz_t q) {
+	prod_tree *t = (prod_tree *)c->tree;
+	mpz_t x;
+
+	if (t == NULL) {
+		mpz_set_ui(r, 1);
+		mpz_mod(r, r, q);
+		return;
+	}
+	mpz_init(x);
+	mpz_mod(r, tree_read(t, 0, 0, c->count - 1, x), q);
+	mpz_clear(x);
+}
+
+// Visits the children of the node `k` of `from..to`, `g` is the common
+// part of its product and the query.
+static size_t corpus_rec(prod_tree *t, size_t *hits, size_t max, size_t found,
+const mpz_t g, size_t k, size_t from, size_t to) {
+	size_t m, child[2], first[2], last[2], i;
+	mpz_t h, x;
+
+	if (from == to) {
+		if (found < max)
+			hits[found] = from;
+		return found + 1;
+	}
+	m = split_at(NULL, from, to);
+	child[0] = k + 1;
+	first[0] = from;
+	last[0] = m;
+	child[1] = k + tree_right(from, m);
+	first[1] = m + 1;
+	last[1] = to;
+
+	mpz_init(h);
+	mpz_init(x);
+	for (i = 0; i < 2; i++) {
+		mpz_mod(h, tree_read(t, child[i], first[i], last[i], x), g);
+		mpz_gcd(h, h, g);
+		if (mpz_cmp_ui(h, 1) != 0)
+			found = corpus_rec(t, hits, max, found, h, child[i], first[i], last[i]);
+	}
+	mpz_clear(h);
+	mpz_clear(x);
+	return found;
+}
+
+// Stores the indices of up to `max` keys which share a factor with `n` in
+// `hits` and returns the count of these keys. A key equal to `n` is found
+// too.
+size_t corpus_query(const copri_corpus *c, size_t *hits, size_t max,
+const mpz_t n) {
+	size_t found = 0;
+	mpz_t g;
+
+	if (c->tree == NULL)
+		return 0;
+	mpz_init(g);
+	corpus_mod(g, c, n);
+	mpz_gcd(g, g, n);
+	if (mpz_cmp_ui(g, 1) != 0)
+		found = corpus_rec((prod_tree *)c->tree, hits, max, 0, g, 0, 0, c->count - 1);
+	mpz_clear(g);
+	return found;
+}
+
+// Visits the keys `s[from..to]` below the node `k` of their product tree,
+// `r` is the product of the corpus modulo the product of the node.
+static void corpus_gcds_rec(mpz_pool *pool, mpz_array *ret, const mpz_t r,
+mpz_t *s, prod_tree *t, size_t k, size_t from, size_t to) {
+	mpz_t x;
+	size_t m;
+
+	pool_pop(pool, x);
+	if (from == to) {
+		mpz_gcd(x, r, s[from]);
+		array_add(ret, x);
+		pool_push(pool, x);
+		return;
+	}
+	m = split_at(NULL, from, to);
+	mpz_mod(x, r, tree_get(t, k + 1, from, m));
+	corpus_gcds_rec(pool, ret, x, s, t, k + 1, from, m);
+	tree_put(t, k + 1, from, m);
+	mpz_mod(x, r, tree_get(t, k + tree_right(from, m), m + 1, to));
+	corpus_gcds_rec(pool, ret, x, s, t, k + tree_right(from, m), m + 1, to);
+	tree_put(t, k + tree_right(from, m), m + 1, to);
+	pool_push(pool, x);
+}
+
+// Appends gcd(s[i], prod) for every key of `s` to `ret`, where prod is
+// the product of the corpus. This is the batch version of `corpus_query`:
+// the root of the corpus is reduced once modulo the product of `s` and
+// then down the product tree of `s` (a remainder tree), so the keys are
+// tested in about the time of two passes over both products.
+//
+// See [registry test](test-registry.html) for basic usage.
+void corpus_gcds(mpz_pool *pool, mpz_array *ret, const copri_corpus *c,
+mpz_array *s) {
+	prod_tree tree;
+	mpz_t r;
+
+	if (s->used == 0)
+		return;
+	pool_pop(pool, r);
+	tree_init(&tree, s->array, 0, s->used - 1, NULL, NULL);
+	corpus_mod(r, c, tree_get(&tree, 0, 0, s->used - 1));
+	tree_put(&tree, 0, 0, s->used - 1);
+	corpus_gcds_rec(pool, ret, r, s->array, &tree, 0, 0, s->used - 1);
+	tree_clear(&tree, 0, s->used - 1);
+	pool_push(pool, r);
+}
+
+// ### Scanning two corpora
+
+// Appends the pairs of a key of `a` and a key of `b` with a common factor
+// to `out` as (a[i], b[j], gcd(a[i], b[j])), ordered by the key of `b`
+// and then by the key of `a`. Common factors of keys on the same side are
+// not searched, so both sides should be checked on their own before. A
+// key contained in both sides is not paired with itself.
+//
+// The product tree of `a` reduces the keys of `b` by `corpus_gcds`, so the
+// keys of `b` with a common factor are known after about two passes over
+// the products, much less than a `cbmerge` of both bases. For each of
+// them `corpus_query` descends the same tree to the keys of `a` it shares
+// a factor with.
+//
+// See [cross test](test-cross.html) for basic usage.
+void cross_factors(mpz_pool *pool, mpz_array *out, mpz_array *a, mpz_array *b) {
+	mpz_array gb;
+	copri_corpus c;
+	size_t i, j, k, m, max = 8, *hits;
+	mpz_t g;
+
+	if (a->used == 0 || b->used == 0)
+		return;
+	array_init(&gb, b->used);
+	corpus_init(&c, a->array, a->used);
+	corpus_gcds(pool, &gb, &c, b);
+
+	hits = (size_t *)malloc(max * sizeof(size_t));
+	pool_pop(pool, g);
+	for (j = 0; j < b->used; j++) {
+		if (mpz_cmp_ui(gb.array[j], 1) == 0)
+			continue;
+		m = corpus_query(&c, hits, max, b->array[j]);
+		if (m > max) {
+			max = m;
+			hits = (size_t *)realloc(hits, max * sizeof(size_t));
+			corpus_query(&c, hits, max, b->array[j]);
+		}
+		for (k = 0; k < m; k++) {
+			i = hits[k];
+			if (mpz_cmp(a->array[i], b->array[j]) == 0)
+				continue;
+			mpz_gcd(g, a->array[i], b->array[j]);
+			array_add(out, a->array[i]);
+			array_add(out, b->array[j]);
+			array_add(out, g);
+		}
+	}
+	pool_push(pool, g);
+	free(hits);
+	corpus_clear(&c);
+	array_clear(&gb);
+}
@@ -9,12 +9,86 @@
 #include "array.h"
 #include "pool.h"
 
+#define COPRI_SPLIT_COUNT 0
+#define COPRI_SPLIT_BITS 1
+
+// A prepared modulus `n` with its reciprocal `x` of precision `p` bit,
+// `p` is 0 without reciprocal.
+typedef struct {
+	mpz_srcptr n;
+	mpz_t x;
+	size_t p;
+} copri_modulus;
+
+// The product tree of `array[0..count-1]` for queries, see `corpus_init`.
+typedef struct {
+	mpz_t *array;
+	size_t count;
+	void *tree;
+} copri_corpus;
+
+void copri_set_split(int strategy);
+
+int copri_get_split();
+
+void copri_set_leaf(size_t size);
+
+size_t copri_get_leaf();
+
+void copri_set_tree_step(size_t step);
+
+size_t copri_get_tree_step();
+
+void copri_set_tree_memory(size_t bytes);
+
+size_t copri_get_tree_memory();
+
+void copri_set_tree_dir(const char *dir);
+
+const char *copri_get_tree_dir();
+
+void copri_set_tree_disk_bytes(size_t bytes);
+
+size_t copri_get_tree_disk_bytes();
+
+void copri_set_checkpoint(const char *dir, double interval);
+
+const char *copri_get_checkpoint_dir();
+
+double copri_get_checkpoint_interval();
+
+void copri_set_resume(int resume);
+
+int copri_get_resume();
+
+void copri_set_mul_threshold(size_t limbs);
+
+size_t copri_get_mul_threshold();
+
+void parallel_mul(mpz_t rot, const mpz_t a, const mpz_t b);
+
+void parallel_fdiv_qr(mpz_t q, mpz_t r, const mpz_t a, const mpz_t d);
+
+void parallel_fdiv_q(mpz_t q, const mpz_t a, const mpz_t d);
+
+void parallel_gcd(mpz_t g, const mpz_t a, const mpz_t b);
+
+void modulus_init(copri_modulus *m, const mpz_t n);
+
+void modulus_clear(copri_modulus *m);
+
+void modulus_fdiv_r(mpz_t r, const mpz_t a, const copri_modulus *m);
+
 void two_power(mpz_t rot, unsigned long long n);
 
 void gcd_ppi_ppo(mpz_pool *pool, mpz_t gcd, mpz_t ppi, mpz_t ppo, const mpz_t a, const mpz_t c);
 
 void ppi_ppo(mpz_pool *pool, mpz_t ppi, mpz_t ppo, const mpz_t a, const mpz_t c);
 
+void modulus_ppi_ppo(mpz_pool *pool, mpz_t ppi, mpz_t ppo, const mpz_t a, const copri_modulus *m);
+
+void modulus_ppi(mpz_pool *pool, mpz_t ppi, const mpz_t a, const copri_modulus *m);
+
 void ppi(mpz_pool *pool, mpz_t ppi, const mpz_t a, const mpz_t c);
 
 void gcd_ppg_pple(mpz_pool *pool, mpz_t gcd, mpz_t ppg, mpz_t pple, const mpz_t a, const mpz_t b);
@@ -25,6 +99,10 @@ void prod(mpz_pool *pool, mpz_ptr rot, mpz_t * array, size_t from, size_t to);
 
 void array_prod(mpz_pool *pool, mpz_array *a, mpz_ptr rot);
 
+void huffman_prod(mpz_pool *pool, mpz_ptr rot, mpz_t * array, size_t from, size_t to);
+
+void array_huffman_prod(mpz_pool *pool, mpz_array *a, mpz_ptr rot);
+
 void split(mpz_pool *pool, mpz_array *ret, const mpz_t a, mpz_t *p, size_t from, size_t to);
 
 void array_split(mpz_pool *pool, mpz_array *ret, const mpz_t a, mpz_array *p);
@@ -33,10 +111,14 @@ void cbextend(mpz_pool *pool, mpz_array *ret, mpz_array *p, const mpz_t b);
 
 void cbmerge(mpz_pool *pool, mpz_array *s, mpz_array *p, mpz_array *q);
 
+void cbmerge_tree(mpz_array *ret, mpz_array *s, size_t count);
+
 void cb(mpz_pool *pool, mpz_array *ret, mpz_t *s, size_t from, size_t to);
 
 void array_cb(mpz_pool *pool, mpz_array *ret, mpz_array *s);
 
+void cbupdate(mpz_pool *pool, mpz_array *ret, mpz_array *p, mpz_array *s);
+
 void reduce(mpz_pool *pool, mpz_t i, mpz_t pai, const mpz_t p, const mpz_t a);
 
 int find_factor(mpz_pool *pool, mpz_array *out, const mpz_t a0, const mpz_t a, mpz_t *p, size_t from, size_t to);
@@ -47,4 +129,16 @@ void find_factors(mpz_pool *pool, mpz_array *out, mpz_t *s, size_t from, size_t
 
 void array_find_factors(mpz_pool *pool, mpz_array *out, mpz_array *s, mpz_array *p);
 
+void corpus_init(copri_corpus *c, mpz_t *array, size_t count);
+
+void corpus_clear(copri_corpus *c);
+
+void corpus_mod(mpz_t r, const copri_corpus *c, const mpz_t q);
+
+size_t corpus_query(const copri_corpus *c, size_t *hits, size_t max, const mpz_t n);
+
+void corpus_gcds(mpz_pool *pool, mpz_array *ret, const copri_corpus *c, mpz_array *s);
+
+void cross_factors(mpz_pool *pool, mpz_array *out, mpz_array *a, mpz_array *b);
+
 #endif /* COPRI_H */
@@ -0,0 +1,326 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "extsort.h"
+#include "array.h"
+
+// # external sort
+//
+// Sorts lists of integers in the raw gmp format which do not fit
+// into memory.
+//
+// The inputs are read in runs which fit into the memory `budget`, every
+// run is sorted in memory and written to a temporary file. The runs are
+// combined by a k-way merge which streams the sorted integers to the
+// output. Duplicates can be removed during the merge.
+//
+// See [extsort test](test-extsort.html) for basic usage.
+
+// The stdio buffer size of every run during the merge.
+#define EXTSORT_BUFFER 65536
+
+// The maximal number of runs merged at once, limits the open files.
+#define EXTSORT_MAX_FANIN 256
+
+// The estimated memory usage of an integer in a run.
+#define EXTSORT_INT_SIZE(i) (sizeof(mpz_t) + mpz_size(i) * sizeof(mp_limb_t))
+
+typedef struct {
+	FILE **files;
+	size_t used;
+	size_t size;
+} extsort_runs;
+
+// Opens an anonymous temporary file in `tmpdir`. If `tmpdir` is `NULL`
+// the directory from `TMPDIR` or `/tmp` is used.
+FILE *extsort_tmpfile(const char *tmpdir) {
+	char path[4096];
+	int fd;
+	FILE *f;
+
+	if (tmpdir == NULL) tmpdir = getenv("TMPDIR");
+	if (tmpdir == NULL) tmpdir = "/tmp";
+	if (snprintf(path, sizeof(path), "%s/copri-run-XXXXXX", tmpdir) >= sizeof(path))
+		return NULL;
+	fd = mkstemp(path);
+	if (fd < 0) return NULL;
+	unlink(path);
+	f = fdopen(fd, "w+");
+	if (f == NULL) close(fd);
+	return f;
+}
+
+// Opens a new run. The merge buffer is set before the first read or
+// write, `setvbuf` is undefined on a stream which was used already.
+static FILE *extsort_run_file(const char *tmpdir) {
+	FILE *f;
+
+	f = extsort_tmpfile(tmpdir);
+	if (f != NULL)
+		setvbuf(f, NULL, _IOFBF, EXTSORT_BUFFER);
+	return f;
+}
+
+static void extsort_runs_add(extsort_runs *r, FILE *f) {
+	if (r->used == r->size) {
+		r->size = r->size ? r->size * 2 : 16;
+		r->files = (FILE **)realloc(r->files, r->size * sizeof(FILE *));
+	}
+	r->files[r->used++] = f;
+}
+
+static int extsort_cmp(const void *a, const void *b) {
+	return mpz_cmp(*(const mpz_t *)a, *(const mpz_t *)b);
+}
+
+// ### Run generation
+
+// Sorts the integers of `a` and writes them to a new run.
+// `qsort` is used instead of `array_msort`, because it sorts in place
+// and does not double the memory of the run.
+static int extsort_write_run(extsort_runs *runs, mpz_array *a,
+const char *tmpdir, int dedup) {
+	size_t i;
+	FILE *f;
+
+	qsort(a->array, a->used, sizeof(mpz_t), extsort_cmp);
+	f = extsort_run_file(tmpdir);
+	if (f == NULL) {
+		fprintf(stderr, "Can't create a temporary run file\n");
+		return 1;
+	}
+	for (i = 0; i < a->used; i++) {
+		if (dedup && i > 0 && mpz_cmp(a->array[i-1], a->array[i]) == 0)
+			continue;
+		if (mpz_out_raw(f, a->array[i]) == 0) {
+			fprintf(stderr, "Can't write a temporary run file\n");
+			fclose(f);
+			return 2;
+		}
+	}
+	extsort_runs_add(runs, f);
+	array_clear(a);
+	array_init(a, 0);
+	return 0;
+}
+
+// Reads all `inputs` and splits them into sorted runs. An input named `-`
+// is read from stdin.
+static int extsort_generate_runs(extsort_runs *runs, const char **inputs,
+size_t n_inputs, size_t budget, int dedup, const char *tmpdir,
+extsort_stats *stats) {
+	size_t i, used = 0;
+	mpz_array a;
+	mpz_t buf;
+	FILE *in;
+	int r = 0;
+
+	mpz_init(buf);
+	array_init(&a, 0);
+	for (i = 0; i < n_inputs && r == 0; i++) {
+		if (strcmp(inputs[i], "-") == 0) {
+			in = stdin;
+		} else {
+			in = fopen(inputs[i], "r");
+			if (in == NULL) {
+				fprintf(stderr, "Can't load %s\n", inputs[i]);
+				r = 3;
+				break;
+			}
+		}
+		while (mpz_inp_raw(buf, in) > 0) {
+			stats->read++;
+			used += EXTSORT_INT_SIZE(buf);
+			array_add(&a, buf);
+			if (used >= budget) {
+				r = extsort_write_run(runs, &a, tmpdir, dedup);
+				used = 0;
+				if (r != 0) break;
+			}
+		}
+		if (in != stdin)
+			fclose(in);
+	}
+	if (r == 0 && a.used > 0)
+		r = extsort_write_run(runs, &a, tmpdir, dedup);
+	array_clear(&a);
+	mpz_clear(buf);
+	return r;
+}
+
+// ### k-way merge
+
+// The heads of the merged runs, ordered as binary min heap.
+typedef struct {
+	mpz_t *heads;
+	FILE **files;
+	size_t *heap;
+	size_t used;
+} extsort_heap;
+
+static int extsort_heap_less(extsort_heap *h, size_t a, size_t b) {
+	return mpz_cmp(h->heads[h->heap[a]], h->heads[h->heap[b]]) < 0;
+}
+
+static void extsort_heap_down(extsort_heap *h, size_t i) {
+	size_t c, t;
+	while ((c = 2 * i + 1) < h->used) {
+		if (c + 1 < h->used && extsort_heap_less(h, c + 1, c))
+			c++;
+		if (!extsort_heap_less(h, c, i))
+			break;
+		t = h->heap[i]; h->heap[i] = h->heap[c]; h->heap[c] = t;
+		i = c;
+	}
+}
+
+// Merges the runs `files[0..n-1]` into `out`. Returns the count of written
+// integers in `written` and the count of distinct integers in `unique`.
+// If `out` is `NULL` the integers are only counted.
+static int extsort_merge(FILE *out, FILE **files, size_t n, int dedup,
+size_t *written, size_t *unique) {
+	extsort_heap h;
+	mpz_t last;
+	size_t i, top;
+	int has_last = 0, emit, r = 0;
+
+	h.heads = (mpz_t *)malloc(n * sizeof(mpz_t));
+	h.files = files;
+	h.heap = (size_t *)malloc(n * sizeof(size_t));
+	h.used = 0;
+	mpz_init(last);
+
+	for (i = 0; i < n; i++) {
+		mpz_init(h.heads[i]);
+		rewind(files[i]);
+		if (mpz_inp_raw(h.heads[i], files[i]) > 0)
+			h.heap[h.used++] = i;
+	}
+	for (i = h.used; i-- > 0;) {
+		extsort_heap_down(&h, i);
+	}
+
+	*written = *unique = 0;
+	while (h.used > 0) {
+		top = h.heap[0];
+		emit = !dedup;
+		if (!has_last || mpz_cmp(last, h.heads[top]) != 0) {
+			(*unique)++;
+			has_last = emit = 1;
+			mpz_set(last, h.heads[top]);
+		}
+		if (emit) {
+			if (out != NULL && mpz_out_raw(out, h.heads[top]) == 0) {
+				r = 2;
+				break;
+			}
+			(*written)++;
+		}
+		// Refill the head of the run or drop the exhausted run.
+		if (mpz_inp_raw(h.heads[top], files[top]) == 0) {
+			h.heap[0] = h.heap[--h.used];
+		}
+		extsort_heap_down(&h, 0);
+	}
+	if (r != 0)
+		fprintf(stderr, "Can't write the merged output\n");
+
+	for (i = 0; i < n; i++) {
+		mpz_clear(h.heads[i]);
+	}
+	free(h.heads);
+	free(h.heap);
+	mpz_clear(last);
+	return r;
+}
+
+// ### Sort files
+
+// Sorts the integers of all `inputs` and writes them to `out`.
+// The sorted runs in memory are limited to about `budget` bytes.
+// If `dedup` is set duplicates are removed.
+//
+// Returns `0` on success and fills `stats` (if not `NULL`).
+int extsort(FILE *out, const char **inputs, size_t n_inputs,
+size_t budget, int dedup, const char *tmpdir, extsort_stats *stats) {
+	extsort_runs runs, next;
+	extsort_stats local;
+	size_t i, n, written, unique, fanin;
+	FILE *f;
+	int r;
+
+	if (stats == NULL) stats = &local;
+	memset(stats, 0, sizeof(extsort_stats));
+	memset(&runs, 0, sizeof(extsort_runs));
+
+	// Every run requires a buffer during the merge.
+	fanin = budget / EXTSORT_BUFFER;
+	if (fanin < 2) fanin = 2;
+	if (fanin > EXTSORT_MAX_FANIN) fanin = EXTSORT_MAX_FANIN;
+
+	r = extsort_generate_runs(&runs, inputs, n_inputs, budget, dedup,
+		tmpdir, stats);
+	stats->runs = runs.used;
+
+	// Merge groups of runs until the remaining runs can be merged
+	// into the output in one pass.
+	while (r == 0 && runs.used > fanin) {
+		memset(&next, 0, sizeof(extsort_runs));
+		for (i = 0; i < runs.used && r == 0; i += fanin) {
+			n = runs.used - i < fanin ? runs.used - i : fanin;
+			f = extsort_run_file(tmpdir);
+			if (f == NULL) {
+				fprintf(stderr, "Can't create a temporary run file\n");
+				r = 1;
+				break;
+			}
+			r = extsort_merge(f, runs.files + i, n, dedup, &written, &unique);
+			extsort_runs_add(&next, f);
+		}
+		for (i = 0; i < runs.used; i++) {
+			fclose(runs.files[i]);
+		}
+		free(runs.files);
+		runs = next;
+	}
+
+	if (r == 0) {
+		r = extsort_merge(out, runs.files, runs.used, dedup,
+			&stats->written, &stats->unique);
+	}
+	for (i = 0; i < runs.used; i++) {
+		fclose(runs.files[i]);
+	}
+	free(runs.files);
+	return r;
+}
+
+// Sorts the integers of all `inputs` and stores them in a file.
+// Like `array_to_file` the file is appended and `-` writes to stdout.
+int extsort_to_file(const char *filename, const char **inputs,
+size_t n_inputs, size_t budget, int dedup, const char *tmpdir,
+extsort_stats *stats) {
+	FILE *out;
+	int r;
+
+	if (strcmp(filename, "-") == 0) {
+		out = stdout;
+	} else {
+		out = fopen(filename, "a+");
+		if (out == NULL) {
+			fprintf(stderr, "Can't open %s\n", filename);
+			return 4;
+		}
+	}
+	r = extsort(out, inputs, n_inputs, budget, dedup, tmpdir, stats);
+	if (strcmp(filename, "-") != 0)
+		fclose(out);
+	return r;
+}
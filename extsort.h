@@ -0,0 +1,25 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stdio.h>
+#include <gmp.h>
+
+typedef struct {
+	size_t read;
+	size_t written;
+	size_t unique;
+	size_t runs;
+} extsort_stats;
+
+FILE *extsort_tmpfile(const char *tmpdir);
+
+int extsort(FILE *out, const char **inputs, size_t n_inputs, size_t budget, int dedup, const char *tmpdir, extsort_stats *stats);
+
+int extsort_to_file(const char *filename, const char **inputs, size_t n_inputs, size_t budget, int dedup, const char *tmpdir, extsort_stats *stats);
+
+#endif /* EXTSORT_H */
@@ -6,9 +6,16 @@
 // This file contains a balanced split util application
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <gmp.h>
 #include "copri.h"
+#include "hash.h"
+#include "fixed.h"
+#include "registry.h"
+
+// The count of keys tested with one gcd.
+#define FILTER_BATCH 64
 
 #define PRODUCT_1000PRIMES "678629608419755514953266004896957820972161078160377361970324401521111792080121479864721936071815069425907219215791646774510151130705671056416094404541167439287735488353736963531288441938981088407654256240451529081607242659988552012480001287133802278572298314458227654950008738955663072953766341488209509227159933381319371567666804963833249523370831655778314080604712246344649628072459805028063160913071005795183295590443375991860551286230065601580359306757988823124262933259305966372664091680948986620887898883461227980556352852601733860114246410887151983493540958775872577571329277597701163671587052591794386970584444752423596023268793021595936555282977008138833858707329536639661377014042325817639809356799596347944462538427778375525904007169834445567450156949173690701738594584875536885957881452438269676946038980597530032671949818526703398270502591574889228837327819994695664173214894557366363343168494592437205324652573516528943874382178600874878024643322031797588414862315122048846223291257900756812820806739795819803783834366449110996030165071920678407750230118672657378102915524688059208755108467225277065866103666795739208709483959119145497860116133180335757702319385020561042517429031288526721801002679092058170909635701703382390753126302005323612316630558515594616479515096004453718500060291836932140612551722161051067379805065002788004096547708243964735215852734827632098700684466036892770059458754742495711074949314613079781545359495019757827538184361308856825999513366660884541936335491466045305322353749545362962683762333460252556042583248154845846566948014188971651057314058851019340282646752239847232045463969939303431371658607220786663205842510175297602195433569758123945251755043878718459161595137019904240640962465899496512410906852088532419874383895656303779315512987369934711061777117329635461569528504994783413643047392160871963795694958724055597996525917454740621526108635321204763824742430011606570436994644169759611263012712375861911682673548369764923418748711813157811279361700331599397588282864147719911156923709896847720603482450047076226728760035577410722701184878333100234780537897462936378382079055966277885316116887834607362114802378706815302650083359076798475953780285866955566883261644281750278358349579977889429105626865087038835977930842352223971442123281019745568694318200865586150762549114357677130353514342849892002965601064686292493671204318349298134598116662388818407027989992498970986262856712232401426575229549744739851333516937170071337085705197690437625282926914858257689908846227286051735284322402597283976180484905838486513162987381659809287870592690902387482033879184700359561190209417618607868793293476867624464497838299321267571049753373623085351455438610076341961842557148160442782839736179329056237366708383637405663196770746783100179128651460773512143616414356080816160456447832856222804164147618891013658880373227849181446498052320436905124576367614898030410445386643656246089772967461562154147355201124738052009172637452710027640262529821855681129322547617443299372089380860873141895162966481252930360380537684913059090577224188204179681342669502124011214018434733385892140553307905100266308832521127607403573729242486985024795253305646999864066282626291530104297235324933472771821035277094700384260778312268190937365143307612108901729316774669077441981239149913617114331308200242717771235228048768133852203532299832810943137983635951570"
 
@@ -17,20 +24,28 @@
 // Define all variables at the beginning to make the C99 compiler
 // happy.
 int main(int argc, char **argv) {
-  mpz_array s, good, bad;
-  size_t count, i, wc;
-  int c, vflg = 0, jflg = 0, hflg = 0, errflg = 0;
+  mpz_array s, good, bad, known, rest;
+  mpz_hashset blacklist, whitelist;
+  mpz_pool pool;
+  copri_registry registry;
+  size_t count, i, b, e, wc, listed = 0, caught;
+  int c, vflg = 0, jflg = 0, hflg = 0, errflg = 0, batch_bad;
+  char *blacklist_filename = NULL;
+  char *whitelist_filename = NULL;
+  char *registry_filename = NULL;
+  char *black = NULL, *white = NULL;
   char *filename = "primes.lst";
   char *out_good_filename = NULL;
   char *out_bad_filename = NULL;
-  mpz_t product, gcd;
+  mpz_t product, gcd, residue;
+  const fixed_kernel *kernel;
   double percentage;
 
   mpf_set_default_prec(64);
 
   // #### argument parsing
   // Boring `getopt` argument parsing.
-  while ((c = getopt(argc, argv, ":vhjb:g:")) != -1) {
+  while ((c = getopt(argc, argv, ":vhjb:g:k:w:K:")) != -1) {
     switch(c) {
     case 'b':
       out_bad_filename = optarg;
@@ -38,6 +53,15 @@ int main(int argc, char **argv) {
     case 'g':
       out_good_filename = optarg;
       break;
+    case 'k':
+      blacklist_filename = optarg;
+      break;
+    case 'w':
+      whitelist_filename = optarg;
+      break;
+    case 'K':
+      registry_filename = optarg;
+      break;
     case 'v':
       vflg++;
       break;
@@ -65,9 +89,12 @@ int main(int argc, char **argv) {
 
   // Print the usage and exit if an error occurred during argument parsing.
   if (errflg || hflg > 0) {
-    fprintf(stderr, "usage: [-v] [-o FILE] [file]\n"\
+    fprintf(stderr, "usage: [-v] [-b FILE] [-g FILE] [-k FILE] [-w FILE] [-K FILE] [file]\n"\
                     "\n\t-b FILE   to store the bad keys"\
                     "\n\t-g FILE   to store the bod keys"\
+                    "\n\t-k FILE   keys known to be bad (blacklist)"\
+                    "\n\t-w FILE   keys known to be good (whitelist)"\
+                    "\n\t-K FILE   factors known to be bad (registry of app -K)"\
                     "\n\t-j        print json messages"\
                     "\n\t-v        be more verbose"\
                     "\n\n");
@@ -77,7 +104,7 @@ int main(int argc, char **argv) {
   // Load the integers.
   array_init(&s, 10);
   count = array_of_file(&s, filename);
-  if (count == 0) {
+  if (count == 0 && strcmp(filename, "-") != 0 && access(filename, R_OK) != 0) {
     fprintf(stderr, "Can't load %s\n", filename);
     return 1;
   }
@@ -100,24 +127,113 @@ int main(int argc, char **argv) {
 
   mpz_init(product);
   mpz_set_str(product, PRODUCT_1000PRIMES, 10);
+  array_init(&good, 10);
+  array_init(&bad, 10);
+
+  // The keys with a known factor are bad, they are found by a remainder
+  // tree of the registry and skip the other tests.
+  if (registry_filename != NULL) {
+    pool_init(&pool, 0);
+    registry_init(&registry);
+    registry_of_file(&registry, registry_filename);
+    array_init(&known, 9);
+    array_init(&rest, s.used);
+    caught = registry_filter(&pool, &registry, &known, &rest, &s);
+    for (i = 0; i < known.used; i += 3) {
+      array_add(&bad, known.array[i]);
+    }
+    if (vflg) {
+      printf("%zu integers with known factors\n", caught);
+    }
+    registry_to_file(&registry, registry_filename);
+    registry_clear(&registry);
+    array_clear(&known);
+    array_clear(&s);
+    s = rest;
+    pool_clear(&pool);
+  }
+
+  // Look up the listed keys in hash sets, these keys skip the gcd test.
+  if (blacklist_filename != NULL) {
+    hashset_init(&blacklist, 0);
+    if (hashset_of_file(&blacklist, blacklist_filename) == HASHSET_NO_FILE) {
+      fprintf(stderr, "Can't load %s\n", blacklist_filename);
+      return 1;
+    }
+    black = (char *)malloc(s.used);
+    listed += hashset_query(&blacklist, &s, black);
+    hashset_clear(&blacklist);
+  }
+  if (whitelist_filename != NULL) {
+    hashset_init(&whitelist, 0);
+    if (hashset_of_file(&whitelist, whitelist_filename) == HASHSET_NO_FILE) {
+      fprintf(stderr, "Can't load %s\n", whitelist_filename);
+      return 1;
+    }
+    white = (char *)malloc(s.used);
+    listed += hashset_query(&whitelist, &s, white);
+    hashset_clear(&whitelist);
+  }
+  if (vflg && listed > 0) {
+    printf("%zu integers are listed\n", listed);
+  }
 
   if (vflg) {
     printf("filter %zu integers\n", s.used);
   }
 
+  // Use the fixed width gcd if all keys have 1024, 2048 or 4096 bit.
+  kernel = fixed_kernel_for(fixed_width(&s));
+  if (vflg && kernel != NULL) {
+    printf("using the %zu bit kernel\n", kernel->bits);
+  }
+
   mpz_init(gcd);
-  array_init(&good, 10);
-  array_init(&bad, 10);
-  for(i=0; i<s.used; i++) {
-    if (vflg && i % 10000 == 0) {
-      percentage = ((double) i) / ((double) s.used) * 100.0;
-      printf("%.2f%% (%zu of %zu)\n", percentage, i, s.used);
+  mpz_init(residue);
+  for(b=0; b<s.used; b+=FILTER_BATCH) {
+    e = b + FILTER_BATCH < s.used ? b + FILTER_BATCH : s.used;
+
+    // Almost all keys are good, so a whole batch is tested with a single
+    // gcd: the product of its keys modulo the product of the primes is
+    // coprime to it, if every key is. Only the keys of a bad batch are
+    // tested one by one.
+    mpz_set_ui(residue, 1);
+    for(i=b; i<e; i++) {
+      if ((black != NULL && black[i]) || (white != NULL && white[i]))
+        continue;
+      mpz_mul(residue, residue, s.array[i]);
+      mpz_mod(residue, residue, product);
     }
-    mpz_gcd(gcd, s.array[i], product);
-    if (mpz_cmp_ui(gcd, 1) != 0) {
-      array_add(&bad, s.array[i]);
-    } else {
-      array_add(&good, s.array[i]);
+    mpz_gcd(gcd, residue, product);
+    batch_bad = mpz_cmp_ui(gcd, 1) != 0;
+
+    for(i=b; i<e; i++) {
+      if (vflg && i % 10000 == 0) {
+        percentage = ((double) i) / ((double) s.used) * 100.0;
+        printf("%.2f%% (%zu of %zu)\n", percentage, i, s.used);
+      }
+      if (black != NULL && black[i]) {
+        array_add(&bad, s.array[i]);
+        continue;
+      }
+      if (white != NULL && white[i]) {
+        array_add(&good, s.array[i]);
+        continue;
+      }
+      if (!batch_bad) {
+        array_add(&good, s.array[i]);
+        continue;
+      }
+      if (kernel != NULL) {
+        kernel->gcd(gcd, s.array[i], product);
+      } else {
+        mpz_gcd(gcd, s.array[i], product);
+      }
+      if (mpz_cmp_ui(gcd, 1) != 0) {
+        array_add(&bad, s.array[i]);
+      } else {
+        array_add(&good, s.array[i]);
+      }
     }
   }
 
@@ -146,4 +262,7 @@ int main(int argc, char **argv) {
   array_clear(&s);
   mpz_clear(product);
   mpz_clear(gcd);
+  mpz_clear(residue);
+  free(black);
+  free(white);
 }
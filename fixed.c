@@ -0,0 +1,103 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "fixed.h"
+
+// # fixed width kernels
+//
+// Most keys have exactly 1024, 2048 or 4096 bit. For these widths the
+// multiplication and the gcd are done on the `mpn` layer with the limb
+// count known at compile time and the operands in stack buffers, so the
+// size checks, reallocations and sign handling of `mpz` are skipped.
+//
+// The kernels are looked up once by the limb count of the keys, e.g.
+// with `fixed_kernel_for(fixed_width(&keys))`.
+//
+// See [fixed test](test-fixed.html) for basic usage.
+
+// Generates the kernels for keys with `BITS` bit.
+//
+// `mul` expects two positive integers with exactly `N` limbs, `rot` must
+// not be one of the operands.
+//
+// `gcd` expects a positive `a` with exactly `N` limbs and any `b`. A `b`
+// bigger than `a` is reduced modulo `a` first. `mpn_gcd` requires one odd
+// operand, otherwise `mpz_gcd` is used.
+#define FIXED_KERNEL(BITS) \
+enum { N##BITS = BITS / GMP_NUMB_BITS }; \
+\
+static void fixed_mul_##BITS(mpz_t rot, const mpz_t a, const mpz_t b) { \
+	mp_limb_t *r = mpz_limbs_write(rot, 2 * N##BITS); \
+	mpn_mul_n(r, mpz_limbs_read(a), mpz_limbs_read(b), N##BITS); \
+	mpz_limbs_finish(rot, 2 * N##BITS); \
+} \
+\
+static void fixed_gcd_##BITS(mpz_t g, const mpz_t a, const mpz_t b) { \
+	mp_limb_t x[N##BITS], y[N##BITS], r[N##BITS], q[FIXED_MAX_DIVIDEND]; \
+	mp_size_t bn = mpz_size(b), yn = N##BITS, gn; \
+	const mp_limb_t *bp = mpz_limbs_read(b); \
+\
+	if (mpz_sgn(b) <= 0 || bn < N##BITS || (size_t)bn > FIXED_MAX_DIVIDEND) { \
+		mpz_gcd(g, a, b); \
+		return; \
+	} \
+	memcpy(x, mpz_limbs_read(a), sizeof(x)); \
+	if (bn > N##BITS) { \
+		mpn_tdiv_qr(q, y, 0, bp, bn, x, N##BITS); \
+	} else { \
+		memcpy(y, bp, sizeof(y)); \
+	} \
+	while (yn > 0 && y[yn - 1] == 0) yn--; \
+	if (yn == 0) { \
+		mpz_set(g, a); \
+		return; \
+	} \
+	if (!(x[0] & 1) && !(y[0] & 1)) { \
+		mpz_gcd(g, a, b); \
+		return; \
+	} \
+	gn = mpn_gcd(r, x, N##BITS, y, yn); \
+	memcpy(mpz_limbs_write(g, gn), r, gn * sizeof(mp_limb_t)); \
+	mpz_limbs_finish(g, gn); \
+}
+
+FIXED_KERNEL(1024)
+FIXED_KERNEL(2048)
+FIXED_KERNEL(4096)
+
+static const fixed_kernel fixed_kernels[] = {
+	{1024, N1024, fixed_mul_1024, fixed_gcd_1024},
+	{2048, N2048, fixed_mul_2048, fixed_gcd_2048},
+	{4096, N4096, fixed_mul_4096, fixed_gcd_4096}
+};
+
+// Returns the kernel for integers with `limbs` limbs or `NULL`.
+const fixed_kernel *fixed_kernel_for(size_t limbs) {
+	size_t i;
+
+	for (i = 0; i < sizeof(fixed_kernels) / sizeof(fixed_kernel); i++) {
+		if (fixed_kernels[i].limbs == limbs)
+			return &fixed_kernels[i];
+	}
+	return NULL;
+}
+
+// Returns the limb count if all integers of `a` are positive and have
+// the same limb count, otherwise 0.
+size_t fixed_width(mpz_array *a) {
+	size_t i, limbs;
+
+	if (a->used == 0)
+		return 0;
+	limbs = mpz_size(a->array[0]);
+	for (i = 0; i < a->used; i++) {
+		if (mpz_sgn(a->array[i]) <= 0 || mpz_size(a->array[i]) != limbs)
+			return 0;
+	}
+	return limbs;
+}
@@ -0,0 +1,28 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <gmp.h>
+#include "array.h"
+
+// The maximal size in limbs of the bigger gcd operand, which is reduced
+// by the key first. A bigger operand is handled by `mpz_gcd`. The block
+// products of `app-n2` have at most 16 kB.
+#define FIXED_MAX_DIVIDEND (16384 / sizeof(mp_limb_t))
+
+typedef struct {
+	size_t bits;
+	size_t limbs;
+	void (*mul)(mpz_t rot, const mpz_t a, const mpz_t b);
+	void (*gcd)(mpz_t g, const mpz_t a, const mpz_t b);
+} fixed_kernel;
+
+const fixed_kernel *fixed_kernel_for(size_t limbs);
+
+size_t fixed_width(mpz_array *a);
+
+#endif /* FIXED_H */
@@ -0,0 +1,158 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This file contains a throughput benchmark of the pairwise gcd tests in
+// `app-n2` and `filter-bad`.
+//
+// The pairs of a key set are tested with `mpz_gcd`, with the fixed width
+// kernel and by the block products of `app-n2`, where one gcd tests a key
+// against a whole block of keys. The results are printed in tested pairs
+// (gcds) per second. Without a file random odd keys are used.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <gmp.h>
+#include "copri.h"
+#include "fixed.h"
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Creates `count` odd keys with exactly `bits` bit.
+static void keys(mpz_array *s, size_t count, unsigned long bits) {
+	mpz_t x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(x);
+	for (i = 0; i < count; i++) {
+		mpz_urandomb(x, state, bits);
+		mpz_setbit(x, bits - 1);
+		mpz_setbit(x, 0);
+		array_add(s, x);
+	}
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+static void report(const char *name, size_t pairs, double t) {
+	printf("%-16s %10zu pairs %8.3f s %12.0f gcds/s\n", name, pairs, t, pairs / t);
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array s;
+	mpz_t g, p;
+	long int count = 1000, bits = 1024, tile = 128;
+	size_t i, j, pairs, b;
+	const fixed_kernel *k;
+	double t;
+	int c, errflg = 0;
+	char *filename = NULL;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":n:b:t:")) != -1) {
+		switch(c) {
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			bits = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			tile = strtol(optarg, NULL, 0);
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (optind < argc) {
+		filename = argv[optind];
+		if (optind + 1 < argc) errflg++;
+	}
+
+	if (count <= 1 || bits < 16 || tile < 1)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-n COUNT] [-b BITS] [-t TILE] [file]\n"\
+                        "\n\t-n COUNT  the count of random keys"\
+                        "\n\t-b BITS   the bit size of the random keys"\
+                        "\n\t-t TILE   the count of keys per block product"\
+                        "\n\n");
+		exit(2);
+	}
+
+	array_init(&s, count);
+	if (filename != NULL) {
+		if (array_of_file(&s, filename) < 2) {
+			fprintf(stderr, "Can't load %s\n", filename);
+			return 1;
+		}
+	} else {
+		keys(&s, count, bits);
+	}
+	mpz_init(g);
+	mpz_init(p);
+	pairs = s.used * (s.used - 1) / 2;
+	printf("%zu keys\n", s.used);
+
+	t = now();
+	for (i = 0; i < s.used; i++) {
+		for (j = i + 1; j < s.used; j++) {
+			mpz_gcd(g, s.array[i], s.array[j]);
+		}
+	}
+	report("mpz_gcd", pairs, now() - t);
+
+	k = fixed_kernel_for(fixed_width(&s));
+	if (k != NULL) {
+		t = now();
+		for (i = 0; i < s.used; i++) {
+			for (j = i + 1; j < s.used; j++) {
+				k->gcd(g, s.array[i], s.array[j]);
+			}
+		}
+		report("fixed kernel", pairs, now() - t);
+	}
+
+	// Every key is tested against the products of the blocks of `tile`
+	// keys after it, like in `app-n2`. The time of the products is
+	// included.
+	pairs = 0;
+	t = now();
+	for (b = 0; b < s.used; b += tile) {
+		mpz_set_ui(p, 1);
+		for (j = b; j < b + tile && j < s.used; j++) {
+			mpz_mul(p, p, s.array[j]);
+		}
+		for (i = 0; i < b; i++) {
+			mpz_gcd(g, s.array[i], p);
+		}
+		pairs += b * (j - b);
+	}
+	report("block product", pairs, now() - t);
+
+	mpz_clear(g);
+	mpz_clear(p);
+	array_clear(&s);
+	return 0;
+}
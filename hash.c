@@ -0,0 +1,344 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "hash.h"
+#include "config.h"
+
+// # hash auxiliary
+//
+// Fingerprint hashing of integers, used to find equal integers
+// without sorting.
+//
+// See [dedup test](test-dedup.html) and [hashset test](test-hashset.html)
+// for basic usage.
+
+// Number of independent shards used by `array_dedup`. The shard of an
+// integer is selected by the top bits of its fingerprint, so every
+// shard can be processed by its own thread.
+#define DEDUP_SHARD_BITS 6
+#define DEDUP_SHARDS (1 << DEDUP_SHARD_BITS)
+
+// Minimal element count before `array_dedup` and `hashset_query`
+// use multiple threads.
+#define DEDUP_PARALLEL_MIN 4096
+
+#define HASHSET_DEFAULT_SIZE 256
+
+#define HASH_EMPTY SIZE_MAX
+
+// The 64 bit finalizer of splitmix64.
+static uint64_t hash_mix(uint64_t h) {
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+// ### Fingerprint of an integer
+
+// Computes a 64 bit hash of the limbs of `integer`.
+// Equal integers always have equal fingerprints, different integers
+// collide with a probability of about 2^-64, so a full `mpz_cmp` is
+// still required to confirm a match.
+uint64_t mpz_fingerprint(const mpz_t integer) {
+	size_t i, n = mpz_size(integer);
+	const mp_limb_t *limbs = mpz_limbs_read(integer);
+	uint64_t h = hash_mix(0x9e3779b97f4a7c15ULL + n);
+
+	if (mpz_sgn(integer) < 0)
+		h = ~h;
+	for (i = 0; i < n; i++) {
+		h = hash_mix(h ^ (uint64_t)limbs[i]);
+	}
+	return h;
+}
+
+// Returns the smallest power of two which is at least `n`.
+static size_t hash_capacity(size_t n) {
+	size_t c = 16;
+	while (c < n) c *= 2;
+	return c;
+}
+
+// ## Hash set
+
+// A set of integers with a open addressing table (linear probing) over
+// the fingerprints. The table stores indices into `array`, it is kept at
+// most half full, so lookups need O(1) `mpz_cmp` calls on average.
+//
+// The struct `mpz_hashset` is in `hash.h` defined as follows:
+//
+//     typedef struct {
+//        mpz_t *array;
+//        uint64_t *fingerprints;
+//        size_t *table;
+//        size_t used;
+//        size_t size;
+//        size_t capacity;
+//     } mpz_hashset;
+
+// Allocates the hash table with `capacity` empty slots.
+static void hashset_table_init(mpz_hashset *h, size_t capacity) {
+	size_t i;
+	h->capacity = capacity;
+	h->table = (size_t *)malloc(capacity * sizeof(size_t));
+	for (i = 0; i < capacity; i++) {
+		h->table[i] = HASH_EMPTY;
+	}
+}
+
+// Returns the slot of `integer` with the fingerprint `fp`, this is
+// either the slot which contains the integer or the empty slot where
+// it has to be inserted.
+static size_t hashset_slot(mpz_hashset *h, const mpz_t integer, uint64_t fp) {
+	size_t j, mask = h->capacity - 1, slot = fp & mask;
+	while ((j = h->table[slot]) != HASH_EMPTY) {
+		if (h->fingerprints[j] == fp && mpz_cmp(h->array[j], integer) == 0)
+			break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Initialize the set with an capacity of `size` integers.
+void hashset_init(mpz_hashset *h, size_t size) {
+	if (size < 1) size = HASHSET_DEFAULT_SIZE;
+	h->array = (mpz_t *)malloc(size * sizeof(mpz_t));
+	h->fingerprints = (uint64_t *)malloc(size * sizeof(uint64_t));
+	h->used = 0;
+	h->size = size;
+	hashset_table_init(h, hash_capacity(2 * size));
+}
+
+// Frees the memory of the set.
+void hashset_clear(mpz_hashset *h) {
+	size_t i;
+	for (i = 0; i < h->used; i++) {
+		mpz_clear(h->array[i]);
+	}
+	free(h->array);
+	free(h->fingerprints);
+	free(h->table);
+	h->array = NULL;
+	h->fingerprints = NULL;
+	h->table = NULL;
+	h->used = h->size = h->capacity = 0;
+}
+
+// Adds a deep copy of `integer` to the set.
+// Returns `1` if the integer was added and `0` if it is already in the set.
+int hashset_insert(mpz_hashset *h, const mpz_t integer) {
+	uint64_t fp = mpz_fingerprint(integer);
+	size_t i, slot = hashset_slot(h, integer, fp);
+
+	if (h->table[slot] != HASH_EMPTY)
+		return 0;
+
+	if (h->used == h->size) {
+		h->size *= 2;
+		h->array = (mpz_t *)realloc(h->array, h->size * sizeof(mpz_t));
+		h->fingerprints = (uint64_t *)realloc(h->fingerprints,
+			h->size * sizeof(uint64_t));
+	}
+	mpz_init_set(h->array[h->used], integer);
+	h->fingerprints[h->used] = fp;
+	h->table[slot] = h->used++;
+
+	// Rehash with the stored fingerprints if the table is half full.
+	if (2 * h->used > h->capacity) {
+		free(h->table);
+		hashset_table_init(h, 2 * h->capacity);
+		for (i = 0; i < h->used; i++) {
+			h->table[hashset_slot(h, h->array[i], h->fingerprints[i])] = i;
+		}
+	}
+	return 1;
+}
+
+// Test if the set contains the integer.
+int hashset_contains(mpz_hashset *h, const mpz_t integer) {
+	uint64_t fp = mpz_fingerprint(integer);
+	return h->table[hashset_slot(h, integer, fp)] != HASH_EMPTY;
+}
+
+// Adds the integers of the array `a` to the set.
+void hashset_add_array(mpz_hashset *h, mpz_array *a) {
+	size_t i;
+	for (i = 0; i < a->used; i++) {
+		hashset_insert(h, a->array[i]);
+	}
+}
+
+// Adds the integers of a file to the set.
+// Returns the count of read integers, `HASHSET_NO_FILE` if the file can
+// not be opened. An empty file is not an error.
+size_t hashset_of_file(mpz_hashset *h, const char *filename) {
+	size_t count = 0;
+	FILE *in;
+	mpz_t buf;
+	if (strcmp(filename, "-") == 0) {
+		in = stdin;
+	} else {
+		in = fopen(filename, "r");
+		if (in == NULL) return HASHSET_NO_FILE;
+	}
+	mpz_init(buf);
+	while(mpz_inp_raw(buf, in) > 0) {
+		hashset_insert(h, buf);
+		count++;
+	}
+	mpz_clear(buf);
+	if (strcmp(filename, "-") != 0)
+		fclose(in);
+	return count;
+}
+
+// Tests all integers of the array `a` in parallel. If `found` is not
+// `NULL`, `found[i]` is set to `1` if the set contains `a->array[i]`
+// and to `0` otherwise.
+// Returns the count of integers contained in the set.
+size_t hashset_query(mpz_hashset *h, mpz_array *a, char *found) {
+	size_t i, count = 0;
+	char in;
+#if USE_OPENMP
+#pragma omp parallel for private(in) reduction(+:count) if(a->used >= DEDUP_PARALLEL_MIN)
+#endif
+	for (i = 0; i < a->used; i++) {
+		in = hashset_contains(h, a->array[i]) ? 1 : 0;
+		if (found != NULL)
+			found[i] = in;
+		count += in;
+	}
+	return count;
+}
+
+// ## Deduplication
+
+// Deduplicates the `count` integers listed in `idx` with an open
+// addressing hash table of indices.
+static void array_dedup_shard(mpz_array *a, const uint64_t *fp, size_t *canon,
+const size_t *idx, size_t count) {
+	size_t i, j, k, slot, mask, capacity;
+	size_t *table;
+
+	if (count == 0) return;
+	capacity = hash_capacity(2 * count);
+	mask = capacity - 1;
+	table = (size_t *)malloc(capacity * sizeof(size_t));
+	for (i = 0; i < capacity; i++) {
+		table[i] = HASH_EMPTY;
+	}
+
+	// Linear probing, the indices are inserted in ascending order, so
+	// the first occurrence is always the canonical one.
+	for (k = 0; k < count; k++) {
+		i = idx[k];
+		canon[i] = i;
+		slot = fp[i] & mask;
+		while ((j = table[slot]) != HASH_EMPTY) {
+			if (fp[j] == fp[i] && mpz_cmp(a->array[j], a->array[i]) == 0) {
+				canon[i] = j;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		if (canon[i] == i)
+			table[slot] = i;
+	}
+	free(table);
+}
+
+// ### Remove duplicates
+
+// Removes duplicate integers from the array `a` without sorting it.
+// The first occurrence of every integer is kept, so the order of the
+// remaining integers does not change. The integers are moved by
+// `mpz_swap`, no deep copies are made.
+//
+// If `map` is not `NULL` it has to provide space for `a->used` entries.
+// On return `map[i]` holds the index of the original integer `i` in the
+// deduplicated array, so duplicates point to their canonical integer.
+//
+// Returns the number of removed duplicates.
+size_t array_dedup(mpz_array *a, size_t *map) {
+	size_t i, k, s, n = a->used;
+	size_t offsets[DEDUP_SHARDS + 1];
+	size_t fill[DEDUP_SHARDS];
+	uint64_t *fp;
+	size_t *canon, *idx;
+
+	if (n < 2) {
+		if (map != NULL && n == 1) map[0] = 0;
+		return 0;
+	}
+
+	fp = (uint64_t *)malloc(n * sizeof(uint64_t));
+	idx = (size_t *)malloc(n * sizeof(size_t));
+	canon = (map != NULL) ? map : (size_t *)malloc(n * sizeof(size_t));
+
+	// Compute all fingerprints in parallel.
+#if USE_OPENMP
+#pragma omp parallel for if(n >= DEDUP_PARALLEL_MIN)
+#endif
+	for (i = 0; i < n; i++) {
+		fp[i] = mpz_fingerprint(a->array[i]);
+	}
+
+	// Bucket the indices by shard (a stable counting sort).
+	for (s = 0; s <= DEDUP_SHARDS; s++) {
+		offsets[s] = 0;
+	}
+	for (i = 0; i < n; i++) {
+		offsets[(fp[i] >> (64 - DEDUP_SHARD_BITS)) + 1]++;
+	}
+	for (s = 0; s < DEDUP_SHARDS; s++) {
+		offsets[s + 1] += offsets[s];
+		fill[s] = offsets[s];
+	}
+	for (i = 0; i < n; i++) {
+		idx[fill[fp[i] >> (64 - DEDUP_SHARD_BITS)]++] = i;
+	}
+
+	// Equal integers always end up in the same shard, so the shards
+	// are independent of each other.
+#if USE_OPENMP
+#pragma omp parallel for schedule(dynamic) if(n >= DEDUP_PARALLEL_MIN)
+#endif
+	for (s = 0; s < DEDUP_SHARDS; s++) {
+		array_dedup_shard(a, fp, canon, idx + offsets[s],
+			offsets[s + 1] - offsets[s]);
+	}
+
+	// Compact the array. A canonical index is always smaller than the
+	// indices of its duplicates, so it has already been renumbered.
+	k = 0;
+	for (i = 0; i < n; i++) {
+		if (canon[i] == i) {
+			if (k != i)
+				mpz_swap(a->array[k], a->array[i]);
+			canon[i] = k++;
+		} else {
+			canon[i] = canon[canon[i]];
+		}
+	}
+	for (i = k; i < n; i++) {
+		mpz_clear(a->array[i]);
+	}
+	a->used = k;
+
+	free(fp);
+	free(idx);
+	if (map == NULL)
+		free(canon);
+	return n - k;
+}
@@ -0,0 +1,43 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <gmp.h>
+#include "array.h"
+
+typedef struct {
+	mpz_t *array;
+	uint64_t *fingerprints;
+	size_t *table;
+	size_t used;
+	size_t size;
+	size_t capacity;
+} mpz_hashset;
+
+uint64_t mpz_fingerprint(const mpz_t integer);
+
+void hashset_init(mpz_hashset *h, size_t size);
+
+void hashset_clear(mpz_hashset *h);
+
+int hashset_insert(mpz_hashset *h, const mpz_t integer);
+
+int hashset_contains(mpz_hashset *h, const mpz_t integer);
+
+void hashset_add_array(mpz_hashset *h, mpz_array *a);
+
+// The count of `hashset_of_file` for a file which can't be opened.
+#define HASHSET_NO_FILE ((size_t)-1)
+
+size_t hashset_of_file(mpz_hashset *h, const char *filename);
+
+size_t hashset_query(mpz_hashset *h, mpz_array *a, char *found);
+
+size_t array_dedup(mpz_array *a, size_t *map);
+
+#endif /* HASH_H */
@@ -0,0 +1,142 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This file contains a benchmark of the product trees `prod` and
+// `huffman_prod`.
+//
+// Without a file a synthetic set of integers with skewed sizes is used.
+// Otherwise every file is loaded and benchmarked, e.g. the coprime bases
+// written by `app -b` or `app-merge -b`, which are the arrays multiplied
+// in `cbextend` and `cbmerge`.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <gmp.h>
+#include "copri.h"
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Creates `count` integers between 64 bit and 256 kbit. Most integers are
+// small, every size class has half the count of the previous one.
+static void skewed(mpz_array *a, size_t count) {
+	mpz_t x;
+	size_t i, bits;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(x);
+	for (i = 0; i < count; i++) {
+		for (bits = 64; bits < 262144 && gmp_urandomb_ui(state, 1); bits *= 2);
+		mpz_urandomb(x, state, bits);
+		mpz_setbit(x, bits - 1);
+		array_add(a, x);
+	}
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+// Runs both product trees `rounds` times and prints the times.
+static int bench(const char *name, mpz_array *a, long int rounds) {
+	mpz_pool pool;
+	mpz_t p, h;
+	double t, t_prod, t_huffman;
+	long int i;
+	int r = 0;
+
+	pool_init(&pool, 0);
+	mpz_init(p);
+	mpz_init(h);
+
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		array_prod(&pool, a, p);
+	}
+	t_prod = (now() - t) / rounds;
+
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		array_huffman_prod(&pool, a, h);
+	}
+	t_huffman = (now() - t) / rounds;
+
+	if (mpz_cmp(p, h) != 0) {
+		fprintf(stderr, "Products of %s differ\n", name);
+		r = 1;
+	}
+	printf("%s: %zu integers, %zu bits, prod: %.4f s, huffman_prod: %.4f s, speedup: %.2f\n",
+		name, a->used, mpz_sizeinbase(p, 2), t_prod, t_huffman, t_prod / t_huffman);
+
+	mpz_clear(p);
+	mpz_clear(h);
+	pool_clear(&pool);
+	return r;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array a;
+	long int count = 10000, rounds = 3;
+	int c, errflg = 0, r = 0;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":n:r:")) != -1) {
+		switch(c) {
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtol(optarg, NULL, 0);
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (count <= 0 || rounds <= 0)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-n COUNT] [-r ROUNDS] [file ...]\n"\
+                        "\n\t-n COUNT  the count of synthetic integers"\
+                        "\n\t-r ROUNDS the rounds of every benchmark"\
+                        "\n\n");
+		exit(2);
+	}
+
+	if (optind == argc) {
+		array_init(&a, count);
+		skewed(&a, count);
+		r = bench("skewed", &a, rounds);
+		array_clear(&a);
+	}
+
+	for (; optind < argc; optind++) {
+		array_init(&a, 10);
+		if (array_of_file(&a, argv[optind]) == 0) {
+			fprintf(stderr, "Can't load %s\n", argv[optind]);
+			r = 1;
+		} else {
+			r |= bench(argv[optind], &a, rounds);
+		}
+		array_clear(&a);
+	}
+
+	return r;
+}
@@ -0,0 +1,173 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This file contains a latency benchmark of single key queries against a
+// resident corpus, like the requests of `app-daemon`.
+//
+// The product tree of a synthetic corpus is built once with `corpus_init`
+// and every query is answered by `corpus_query`. The median (p50), the 99th
+// percentile (p99) and the maximal latency are printed. A share of the
+// queries (`-h`) has a common prime with one key of the corpus. The other
+// keys have no prime factors below 2^16, so only a few of the other
+// queries hit a key by chance.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <gmp.h>
+#include "copri.h"
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Sets `x` to a random odd integer with `bits` bit without a prime factor
+// below 2^16, the product of these primes is `small`.
+static void key(mpz_t x, gmp_randstate_t state, unsigned long bits,
+const mpz_t small, mpz_t g) {
+	do {
+		mpz_urandomb(x, state, bits);
+		mpz_setbit(x, bits - 1);
+		mpz_setbit(x, 0);
+		mpz_gcd(g, x, small);
+	} while (mpz_cmp_ui(g, 1) != 0);
+}
+
+// Sets `x` to a random prime with `bits` bit.
+static void prime(mpz_t x, gmp_randstate_t state, unsigned long bits) {
+	mpz_urandomb(x, state, bits);
+	mpz_setbit(x, bits - 1);
+	mpz_nextprime(x, x);
+}
+
+static int compare(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array s, q;
+	mpz_t small, x, y, g;
+	copri_corpus corpus;
+	long int count = 100000, bits = 1024, queries = 1000, hit = 10, step = 1;
+	size_t i, j, found = 0, hits[16];
+	unsigned long p;
+	double t, *lat;
+	int c, errflg = 0;
+	gmp_randstate_t state;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":n:b:q:h:k:")) != -1) {
+		switch(c) {
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			bits = strtol(optarg, NULL, 0);
+			break;
+		case 'q':
+			queries = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+			hit = strtol(optarg, NULL, 0);
+			break;
+		case 'k':
+			step = strtol(optarg, NULL, 0);
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (count < 1 || bits < 64 || queries < 1 || hit < 0 || hit > 100 ||
+	step < 1 || optind < argc)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-n COUNT] [-b BITS] [-q QUERIES] [-h PERCENT] [-k STEP]\n"\
+                        "\n\t-n COUNT    the count of keys in the corpus"\
+                        "\n\t-b BITS     the bit size of the keys"\
+                        "\n\t-q QUERIES  the count of queries"\
+                        "\n\t-h PERCENT  the share of queries with a factor in the corpus"\
+                        "\n\t-k STEP     keep only every STEP-th level of the product tree"\
+                        "\n\n");
+		exit(2);
+	}
+
+	gmp_randinit_default(state);
+	mpz_init_set_ui(small, 1);
+	mpz_init(x);
+	mpz_init(y);
+	mpz_init(g);
+	// An odd p is prime if it is coprime to the smaller odd primes.
+	for (p = 3; p < 65536; p += 2) {
+		if (mpz_gcd_ui(NULL, small, p) == 1)
+			mpz_mul_ui(small, small, p);
+	}
+
+	// The queries `i < hit %` share the prime `x` with a random key,
+	// which is replaced by `x * y`.
+	array_init(&s, count);
+	array_init(&q, queries);
+	for (i = 0; i < (size_t)count; i++) {
+		key(x, state, bits, small, g);
+		array_add(&s, x);
+	}
+	for (i = 0; i < (size_t)queries; i++) {
+		if (i * 100 < (size_t)queries * hit) {
+			j = gmp_urandomm_ui(state, count);
+			prime(x, state, bits / 2);
+			prime(y, state, bits - bits / 2);
+			mpz_mul(s.array[j], x, y);
+			prime(y, state, bits - bits / 2);
+			mpz_mul(x, x, y);
+		} else {
+			key(x, state, bits, small, g);
+		}
+		array_add(&q, x);
+	}
+	printf("%zu keys, %zu queries\n", s.used, q.used);
+
+	copri_set_tree_step(step);
+	t = now();
+	corpus_init(&corpus, s.array, s.used);
+	printf("tree build: %8.3f s\n", now() - t);
+
+	lat = (double *)malloc(q.used * sizeof(double));
+	for (i = 0; i < q.used; i++) {
+		t = now();
+		if (corpus_query(&corpus, hits, 16, q.array[i]) > 0)
+			found++;
+		lat[i] = now() - t;
+	}
+	qsort(lat, q.used, sizeof(double), compare);
+	printf("latency p50: %8.3f ms p99: %8.3f ms max: %8.3f ms\n",
+		lat[q.used / 2] * 1e3, lat[q.used * 99 / 100] * 1e3, lat[q.used - 1] * 1e3);
+	printf("%zu hits\n", found);
+
+	free(lat);
+	corpus_clear(&corpus);
+	array_clear(&s);
+	array_clear(&q);
+	mpz_clear(small);
+	mpz_clear(x);
+	mpz_clear(y);
+	mpz_clear(g);
+	gmp_randclear(state);
+	return 0;
+}
@@ -0,0 +1,172 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "registry.h"
+
+// # known factors
+//
+// The same broken random number generators keep producing keys, so a
+// factor found once tends to divide new keys again. The registry keeps
+// all found factors in a hash set, stored as a raw gmp file, and their
+// product tree.
+//
+// `registry_filter` reduces the product of the registry modulo the keys
+// with a remainder tree (`corpus_gcds`). This is much cheaper than a
+// coprime base of the keys, so the keys with a known factor are factored
+// right away and only the other keys go on to `cb` or the batch gcd.
+//
+// See [registry test](test-registry.html) for basic usage.
+
+void registry_init(copri_registry *r) {
+	hashset_init(&r->primes, 0);
+	corpus_init(&r->tree, NULL, 0);
+	r->built = 0;
+	r->stored = 0;
+}
+
+void registry_clear(copri_registry *r) {
+	corpus_clear(&r->tree);
+	hashset_clear(&r->primes);
+}
+
+// The tree refers to the array of the hash set, which moves when it grows,
+// so it is dropped before every insert and built again when it is needed.
+static void registry_drop(copri_registry *r) {
+	corpus_clear(&r->tree);
+	r->built = 0;
+}
+
+static void registry_build(copri_registry *r) {
+	if (r->built == r->primes.used && r->tree.tree != NULL)
+		return;
+	corpus_clear(&r->tree);
+	corpus_init(&r->tree, r->primes.array, r->primes.used);
+	r->built = r->primes.used;
+}
+
+// Adds the factors of a file, a missing file is an empty registry.
+// Returns the count of read integers.
+size_t registry_of_file(copri_registry *r, const char *filename) {
+	size_t count;
+
+	registry_drop(r);
+	count = hashset_of_file(&r->primes, filename);
+	if (count == HASHSET_NO_FILE)
+		count = 0;
+	r->stored = r->primes.used;
+	return count;
+}
+
+// Appends the factors which are not stored yet to a file.
+// Returns the count of written integers.
+size_t registry_to_file(copri_registry *r, const char *filename) {
+	mpz_array a;
+	size_t count;
+
+	if (r->stored == r->primes.used)
+		return 0;
+	a.array = r->primes.array + r->stored;
+	a.used = a.size = r->primes.used - r->stored;
+	count = array_to_file(&a, filename);
+	r->stored += count;
+	return count;
+}
+
+// Adds the factor `p`, returns 1 if it is new.
+int registry_add(copri_registry *r, const mpz_t p) {
+	if (mpz_cmp_ui(p, 1) <= 0 || hashset_contains(&r->primes, p))
+		return 0;
+	registry_drop(r);
+	return hashset_insert(&r->primes, p);
+}
+
+// Adds the prime factors of the triples (key, p, q) of `find_factors`.
+// Returns the count of new factors.
+size_t registry_add_factors(copri_registry *r, mpz_array *out) {
+	size_t i, count = 0;
+
+	for (i = 0; i + 2 < out->used; i += 3) {
+		if (mpz_probab_prime_p(out->array[i+1], 25))
+			count += registry_add(r, out->array[i+1]);
+		if (mpz_probab_prime_p(out->array[i+2], 25))
+			count += registry_add(r, out->array[i+2]);
+	}
+	return count;
+}
+
+// Tests `keys` against the factors `c`. The caught keys are appended to
+// `out` as (key, p, q), the cofactors q to `found` and the other keys to
+// `next`.
+static void registry_round(mpz_pool *pool, const copri_corpus *c, mpz_array *out,
+mpz_array *found, mpz_array *next, mpz_array *keys) {
+	mpz_array g;
+	mpz_t q;
+	size_t i, hit;
+
+	array_init(&g, keys->used);
+	corpus_gcds(pool, &g, c, keys);
+	pool_pop(pool, q);
+	for (i = 0; i < keys->used; i++) {
+		// The gcd is the key if all its factors are known, the tree gives
+		// one of them.
+		if (mpz_cmp(g.array[i], keys->array[i]) == 0 &&
+		corpus_query(c, &hit, 1, keys->array[i]) > 0)
+			mpz_set(g.array[i], c->array[hit]);
+		if (mpz_cmp_ui(g.array[i], 1) == 0 ||
+		mpz_cmp(g.array[i], keys->array[i]) == 0) {
+			array_add(next, keys->array[i]);
+			continue;
+		}
+		mpz_divexact(q, keys->array[i], g.array[i]);
+		array_add(out, keys->array[i]);
+		array_add(out, g.array[i]);
+		array_add(out, q);
+		array_add(found, q);
+	}
+	pool_push(pool, q);
+	array_clear(&g);
+}
+
+// Appends the keys of `s` with a known factor to `out` as (key, p, q) like
+// `find_factors` and the other keys to `rest`. A prime cofactor q of a
+// caught key is added to the registry and the other keys are tested
+// against the new factors again, so the keys which only share q are
+// caught too. Returns the count of caught keys.
+size_t registry_filter(mpz_pool *pool, copri_registry *r, mpz_array *out,
+mpz_array *rest, mpz_array *s) {
+	mpz_array keys, next, found;
+	copri_corpus c;
+	size_t i, from, caught = out->used;
+
+	array_init(&keys, s->used + 1);
+	array_add_array(&keys, s);
+	registry_build(r);
+	from = 0;
+	while (keys.used > 0 && from < r->primes.used) {
+		array_init(&next, keys.used);
+		array_init(&found, 4);
+		if (from == 0) {
+			registry_round(pool, &r->tree, out, &found, &next, &keys);
+		} else {
+			corpus_init(&c, r->primes.array + from, r->primes.used - from);
+			registry_round(pool, &c, out, &found, &next, &keys);
+			corpus_clear(&c);
+		}
+		from = r->primes.used;
+		for (i = 0; i < found.used; i++) {
+			if (mpz_probab_prime_p(found.array[i], 25))
+				registry_add(r, found.array[i]);
+		}
+		array_clear(&found);
+		array_clear(&keys);
+		keys = next;
+	}
+	array_add_array(rest, &keys);
+	array_clear(&keys);
+	return (out->used - caught) / 3;
+}
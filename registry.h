@@ -0,0 +1,39 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <gmp.h>
+#include "array.h"
+#include "pool.h"
+#include "hash.h"
+#include "copri.h"
+
+// The known factors in a hash set and their product tree, the tree covers
+// the first `built` factors. The first `stored` factors are in the file.
+typedef struct {
+	mpz_hashset primes;
+	copri_corpus tree;
+	size_t built;
+	size_t stored;
+} copri_registry;
+
+void registry_init(copri_registry *r);
+
+void registry_clear(copri_registry *r);
+
+size_t registry_of_file(copri_registry *r, const char *filename);
+
+size_t registry_to_file(copri_registry *r, const char *filename);
+
+int registry_add(copri_registry *r, const mpz_t p);
+
+size_t registry_add_factors(copri_registry *r, mpz_array *out);
+
+size_t registry_filter(mpz_pool *pool, copri_registry *r, mpz_array *out,
+mpz_array *rest, mpz_array *s);
+
+#endif /* REGISTRY_H */
@@ -3,12 +3,14 @@
 // License: GNU Lesser General Public License (LGPL), version 3 or later
 // See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
 
-// This is a test of [copri](copri.html) `cbmerge` function.
+// This is a test of [copri](copri.html) `cbmerge` and `cbmerge_tree`
+// functions.
 #include <stdlib.h>
 #include <stdio.h>
 #include <gmp.h>
 #include "test.h"
 #include "copri.h"
+#include "hash.h"
 
 int tests_passed = 0;
 int tests_failed = 0;
@@ -72,6 +74,63 @@ static char * test() {
 	return 0;
 }
 
+// The merge tree of the coprime bases of `count` sets of keys is the
+// coprime base of all keys. The keys share primes across the sets.
+static char * test_tree(size_t count) {
+	mpz_array keys, all, out, expect, *bases;
+	mpz_t x, y;
+	mpz_pool pool;
+	gmp_randstate_t state;
+	size_t i, j;
+
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	bases = (mpz_array *)malloc(count * sizeof(mpz_array));
+	array_init(&all, 8 * count);
+	array_init(&out, 8 * count);
+	array_init(&expect, 8 * count);
+	mpz_init(x);
+	mpz_init(y);
+	for (i = 0; i < count; i++) {
+		array_init(&keys, 8);
+		for (j = 0; j < 8; j++) {
+			mpz_set_ui(x, 1000 + gmp_urandomm_ui(state, 3000));
+			mpz_nextprime(x, x);
+			mpz_set_ui(y, 1000 + gmp_urandomm_ui(state, 3000));
+			mpz_nextprime(y, y);
+			mpz_mul(x, x, y);
+			array_add(&keys, x);
+			array_add(&all, x);
+		}
+		array_dedup(&keys, NULL);
+		array_init(&bases[i], 8);
+		array_cb(&pool, &bases[i], &keys);
+		array_clear(&keys);
+	}
+	array_dedup(&all, NULL);
+	array_cb(&pool, &expect, &all);
+
+	cbmerge_tree(&out, bases, count);
+
+	array_msort(&out);
+	array_msort(&expect);
+	if (!array_equal(&expect, &out)) {
+		return "out and expect differ!";
+	}
+
+	for (i = 0; i < count; i++)
+		array_clear(&bases[i]);
+	free(bases);
+	array_clear(&all);
+	array_clear(&out);
+	array_clear(&expect);
+	mpz_clear(x);
+	mpz_clear(y);
+	gmp_randclear(state);
+	pool_clear(&pool);
+
+	return 0;
+}
 
 // Run all tests.
 int main(int argc, char **argv) {
@@ -81,5 +140,11 @@ int main(int argc, char **argv) {
 	printf("Test1                          ");
 	test_evaluate(test());
 
+	printf("Tree of 1 base                 ");
+	test_evaluate(test_tree(1));
+
+	printf("Tree of 7 bases                ");
+	test_evaluate(test_tree(7));
+
 	test_end();
 }
@@ -0,0 +1,82 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `cbupdate` function. Adding new
+// keys to the coprime base of the old keys has to give the coprime base
+// of all keys, by `cbextend` for a few keys and by `cbmerge` for more.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Adds the keys `old..old+added-1` to the coprime base of the first `old`
+// keys and compares the result with the coprime base of all of them.
+static char * test(size_t old, size_t added) {
+	mpz_array all, first, last, base, updated, expect;
+	mpz_pool pool;
+	size_t i;
+
+	pool_init(&pool, 0);
+	array_init(&all, old + added);
+	array_init(&first, old + 1);
+	array_init(&last, added + 1);
+	array_init(&base, old + 1);
+	array_init(&updated, old + added);
+	array_init(&expect, old + added);
+	test_keys(&all, old + added, 0, 0);
+	for (i = 0; i < old; i++) {
+		array_add(&first, all.array[i]);
+	}
+	for (i = old; i < old + added; i++) {
+		array_add(&last, all.array[i]);
+	}
+
+	if (old > 0)
+		array_cb(&pool, &base, &first);
+	cbupdate(&pool, &updated, &base, &last);
+	array_cb(&pool, &expect, &all);
+	array_msort(&updated);
+	array_msort(&expect);
+	if (!array_equal(&updated, &expect)) return "updated base differs";
+
+	array_clear(&all);
+	array_clear(&first);
+	array_clear(&last);
+	array_clear(&base);
+	array_clear(&updated);
+	array_clear(&expect);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting cbupdate test\n");
+
+	printf("Testing 1 new key              ");
+	test_evaluate(test(100, 1));
+
+	printf("Testing 6 new keys             ");
+	test_evaluate(test(100, 6));
+
+	printf("Testing 7 new keys             ");
+	test_evaluate(test(100, 7));
+
+	printf("Testing 100 new keys           ");
+	test_evaluate(test(100, 100));
+
+	printf("Testing no new keys            ");
+	test_evaluate(test(100, 0));
+
+	printf("Testing empty base             ");
+	test_evaluate(test(0, 20));
+
+	test_end();
+}
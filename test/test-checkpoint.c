@@ -0,0 +1,259 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of the [copri](copri.html) checkpoints of `cb`. A run
+// with checkpoints has to give the same coprime base and a resumed run
+// has to use the stored subtrees and merge states. The stored results of
+// the resumed runs contain an extra prime `e`, so the result shows if
+// they were used.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// The 40 keys are split into 0..19 and 20..39.
+#define KEYS 40
+
+static char dir[] = "/tmp/copri-checkpoint-XXXXXX";
+
+// Computes the sorted coprime base of `s[from..to]`.
+static void base(mpz_array *ret, mpz_array *s, size_t from, size_t to) {
+	mpz_pool pool;
+
+	pool_init(&pool, 0);
+	cb(&pool, ret, s->array, from, to);
+	array_msort(ret);
+	pool_clear(&pool);
+}
+
+static char *path(const char *name) {
+	static char p[sizeof(dir) + 257];
+	snprintf(p, sizeof(p), "%s/%s", dir, name);
+	return p;
+}
+
+// Stores `header` and `a` in the checkpoint `name`.
+static void store(const char *name, const unsigned long *header, size_t h,
+mpz_array *a) {
+	mpz_array c;
+	mpz_t x;
+	size_t i;
+
+	array_init(&c, a->used + 3);
+	mpz_init(x);
+	for (i = 0; i < h; i++) {
+		mpz_set_ui(x, header[i]);
+		array_add(&c, x);
+	}
+	for (i = 0; i < a->used; i++) {
+		array_add(&c, a->array[i]);
+	}
+	unlink(path(name));
+	array_to_file(&c, path(name));
+	mpz_clear(x);
+	array_clear(&c);
+}
+
+// The keys and the extra prime `e` (the base of the resumed runs).
+static mpz_array s, expected, left;
+static mpz_t e;
+
+// A run with checkpoints after every subtree only leaves the input stamp
+// and the coprime base of all keys.
+static char * test_fresh(double interval) {
+	mpz_array b, plain;
+
+	array_init(&b, KEYS);
+	array_init(&plain, KEYS);
+	copri_set_checkpoint(NULL, 0);
+	base(&plain, &s, 0, KEYS - 1);
+	copri_set_checkpoint(dir, interval);
+	copri_set_resume(0);
+	base(&b, &s, 0, KEYS - 1);
+	copri_set_checkpoint(NULL, 0);
+	if (!array_equal(&b, &plain)) return "base differs";
+	if (access(path("keys.gmp"), F_OK) != 0) return "no input stamp";
+	if (access(path("cb-0-39.gmp"), F_OK) != 0) return "no base of all keys";
+	if (access(path("cb-0-19.gmp"), F_OK) == 0) return "subtree not removed";
+
+	array_clear(&b);
+	array_clear(&plain);
+	return 0;
+}
+
+// Stores a merge state of all keys with the Q of the keys 20..39, `q`
+// of them are stored, and `a` as S or T.
+static void store_merge(unsigned long i, unsigned long phase, size_t q,
+mpz_array *a) {
+	mpz_array state, right;
+	unsigned long header[4];
+	size_t k;
+
+	array_init(&state, KEYS);
+	array_init(&right, KEYS);
+	base(&right, &s, 20, KEYS - 1);
+	header[0] = i;
+	header[1] = phase;
+	header[2] = right.used;
+	header[3] = a->used;
+	for (k = 0; k < q && k < right.used; k++)
+		array_add(&state, right.array[k]);
+	array_add_array(&state, a);
+	store("merge-0-39.gmp", header, 4, &state);
+	array_clear(&state);
+	array_clear(&right);
+}
+
+// Resumes from the stored state, `expect` is the resulting base.
+static char * resume(mpz_array *expect) {
+	mpz_array b;
+
+	array_init(&b, KEYS);
+	copri_set_checkpoint(dir, 0);
+	copri_set_resume(1);
+	base(&b, &s, 0, KEYS - 1);
+	copri_set_checkpoint(NULL, 0);
+	copri_set_resume(0);
+	if (!array_equal(&b, expect)) return "resumed base differs";
+	if (access(path("merge-0-39.gmp"), F_OK) == 0) return "merge not removed";
+
+	array_clear(&b);
+	return 0;
+}
+
+// Resumes from the stored base of the keys 0..19.
+static char * test_resume_cb() {
+	unlink(path("cb-0-39.gmp"));
+	store("cb-0-19.gmp", NULL, 0, &left);
+	return resume(&expected);
+}
+
+// Resumes from a stored merge in iteration `i` and `phase`.
+static char * test_resume_merge(unsigned long i, unsigned long phase) {
+	unlink(path("cb-0-39.gmp"));
+	store_merge(i, phase, KEYS, &left);
+	return resume(&expected);
+}
+
+// A merge state without its complete Q, or a Q of an older version
+// without the merge state, is not used, the keys are computed again.
+static char * test_broken_merge(int truncated) {
+	mpz_array plain;
+	char *msg;
+
+	array_init(&plain, KEYS);
+	base(&plain, &s, 0, KEYS - 1);
+	unlink(path("cb-0-39.gmp"));
+	if (truncated) {
+		store_merge(0, 0, 3, &left);
+	} else {
+		store("q-0-39.gmp", NULL, 0, &left);
+		unlink(path("merge-0-39.gmp"));
+	}
+	msg = resume(&plain);
+	if (msg == 0 && access(path("q-0-39.gmp"), F_OK) == 0)
+		msg = "old q not removed";
+	array_clear(&plain);
+	return msg;
+}
+
+// The stored base of other keys is not used.
+static char * test_other_keys() {
+	mpz_array t, b, plain;
+
+	array_init(&t, KEYS);
+	array_init(&b, KEYS);
+	array_init(&plain, KEYS);
+	test_keys(&t, KEYS, 2, 0);
+	base(&plain, &t, 0, KEYS - 1);
+	copri_set_checkpoint(dir, 0);
+	copri_set_resume(1);
+	base(&b, &t, 0, KEYS - 1);
+	copri_set_checkpoint(NULL, 0);
+	copri_set_resume(0);
+	if (!array_equal(&b, &plain)) return "base of other keys differs";
+
+	array_clear(&t);
+	array_clear(&b);
+	array_clear(&plain);
+	return 0;
+}
+
+static void remove_dir() {
+	DIR *d = opendir(dir);
+	struct dirent *f;
+
+	while (d != NULL && (f = readdir(d)) != NULL) {
+		if (strcmp(f->d_name, ".") != 0 && strcmp(f->d_name, "..") != 0)
+			unlink(path(f->d_name));
+	}
+	if (d != NULL)
+		closedir(d);
+	rmdir(dir);
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+	mpz_array se;
+
+	printf("Starting checkpoint test\n");
+	if (mkdtemp(dir) == NULL) {
+		printf("Can't create %s\n", dir);
+		return 1;
+	}
+
+	array_init(&s, KEYS + 1);
+	array_init(&expected, KEYS + 1);
+	array_init(&left, KEYS);
+	array_init(&se, KEYS + 1);
+	test_keys(&s, KEYS, 1, 0);
+	mpz_init_set_ui(e, 1);
+	mpz_mul_2exp(e, e, 80);
+	mpz_nextprime(e, e);
+	base(&left, &s, 0, 19);
+	array_add(&left, e);
+	array_add_array(&se, &s);
+	array_add(&se, e);
+	base(&expected, &se, 0, KEYS);
+
+	printf("Testing checkpoint per subtree ");
+	test_evaluate(test_fresh(0));
+
+	printf("Testing final checkpoint       ");
+	test_evaluate(test_fresh(1e9));
+
+	printf("Testing resume of subtree      ");
+	test_evaluate(test_resume_cb());
+
+	printf("Testing resume of merge S      ");
+	test_evaluate(test_resume_merge(0, 0));
+
+	printf("Testing resume of merge T      ");
+	test_evaluate(test_resume_merge(0, 1));
+
+	printf("Testing truncated merge        ");
+	test_evaluate(test_broken_merge(1));
+
+	printf("Testing missing merge          ");
+	test_evaluate(test_broken_merge(0));
+
+	printf("Testing resume of other keys   ");
+	test_evaluate(test_other_keys());
+
+	remove_dir();
+	array_clear(&s);
+	array_clear(&expected);
+	array_clear(&left);
+	array_clear(&se);
+	mpz_clear(e);
+	test_end();
+}
@@ -0,0 +1,189 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `corpus_query` function. The
+// keys found by a query have to be the keys with `gcd(key, n) != 1`.
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Queries a corpus of `size` products of two primes with tree step
+// `step`. Every query shares a prime with up to three keys or is new.
+static char * test(size_t size, size_t step) {
+	mpz_array s, primes;
+	copri_corpus c;
+	mpz_t n, g;
+	size_t i, j, k, count, expect, hits[8];
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	array_init(&s, size);
+	array_init(&primes, 2 * size);
+	mpz_init(n);
+	mpz_init(g);
+	for (i = 0; i < 2 * size; i++) {
+		test_prime(n, state, 64);
+		array_add(&primes, n);
+	}
+	// The key i is p_i * p_(i+1) for every third key, so neighbouring
+	// keys share primes.
+	for (i = 0; i < size; i++) {
+		j = i % 3 == 0 ? i + 1 : size + i;
+		mpz_mul(n, primes.array[i], primes.array[j]);
+		array_add(&s, n);
+	}
+
+	copri_set_tree_step(step);
+	corpus_init(&c, s.array, s.used);
+	for (k = 0; k < 40; k++) {
+		test_prime(g, state, 64);
+		if (k % 4 != 3)
+			mpz_mul(n, g, primes.array[(k * 7919) % (2 * size)]);
+		else
+			mpz_mul(n, g, g);
+		if (k == 39)
+			mpz_set(n, s.array[size / 2]);
+
+		count = corpus_query(&c, hits, 8, n);
+		expect = 0;
+		for (i = 0; i < size; i++) {
+			mpz_gcd(g, s.array[i], n);
+			if (mpz_cmp_ui(g, 1) == 0)
+				continue;
+			if (expect >= count || hits[expect] != i)
+				return "missing hit";
+			expect++;
+		}
+		if (count != expect) return "wrong hit count";
+	}
+	corpus_clear(&c);
+	copri_set_tree_step(1);
+
+	array_clear(&s);
+	array_clear(&primes);
+	mpz_clear(n);
+	mpz_clear(g);
+	gmp_randclear(state);
+	return 0;
+}
+
+#define THREADS 4
+
+typedef struct {
+	copri_corpus *c;
+	mpz_array *s;
+	size_t first;
+	size_t *counts;
+} query_job;
+
+// Queries every `THREADS`-th key of the corpus with itself.
+static void *query_keys(void *arg) {
+	query_job *job = (query_job *)arg;
+	size_t i, hits[8];
+
+	for (i = job->first; i < job->s->used; i += THREADS) {
+		job->counts[i] = corpus_query(job->c, hits, 8, job->s->array[i]);
+	}
+	return NULL;
+}
+
+// Queries a corpus with tree step `step` and tree directory `dir` from
+// several threads at once, the hit counts have to be the ones of single
+// queries.
+static char * test_threads(size_t size, size_t step, const char *dir) {
+	mpz_array s;
+	copri_corpus c;
+	query_job jobs[THREADS];
+	pthread_t threads[THREADS];
+	size_t i, *counts, hits[8];
+	mpz_t n;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	array_init(&s, size);
+	mpz_init(n);
+	for (i = 0; i < size; i++) {
+		test_prime(n, state, 64);
+		if (i % 5 == 1)
+			mpz_mul(n, n, s.array[i - 1]);
+		array_add(&s, n);
+	}
+	counts = (size_t *)calloc(size, sizeof(size_t));
+
+	copri_set_tree_step(step);
+	copri_set_tree_dir(dir);
+	copri_set_tree_disk_bytes(0);
+	corpus_init(&c, s.array, s.used);
+	for (i = 0; i < THREADS; i++) {
+		jobs[i].c = &c;
+		jobs[i].s = &s;
+		jobs[i].first = i;
+		jobs[i].counts = counts;
+		pthread_create(&threads[i], NULL, query_keys, &jobs[i]);
+	}
+	for (i = 0; i < THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (i = 0; i < size; i++) {
+		if (counts[i] != corpus_query(&c, hits, 8, s.array[i]))
+			return "wrong hit count";
+	}
+	corpus_clear(&c);
+	copri_set_tree_step(1);
+	copri_set_tree_dir(NULL);
+	copri_set_tree_disk_bytes((size_t)64 << 20);
+
+	free(counts);
+	array_clear(&s);
+	mpz_clear(n);
+	gmp_randclear(state);
+	return 0;
+}
+
+// An empty corpus has no hits.
+static char * test_empty() {
+	copri_corpus c;
+	mpz_t n;
+	size_t hits[1];
+
+	mpz_init_set_ui(n, 15);
+	corpus_init(&c, NULL, 0);
+	if (corpus_query(&c, hits, 1, n) != 0) return "hit in empty corpus";
+	corpus_clear(&c);
+	mpz_clear(n);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting corpus test\n");
+
+	printf("Testing 1 key                  ");
+	test_evaluate(test(1, 1));
+
+	printf("Testing 100 keys               ");
+	test_evaluate(test(100, 1));
+
+	printf("Testing 257 keys, step 3       ");
+	test_evaluate(test(257, 3));
+
+	printf("Testing threads, step 3        ");
+	test_evaluate(test_threads(300, 3, NULL));
+
+	printf("Testing threads, disk, step 2  ");
+	test_evaluate(test_threads(300, 2, "."));
+
+	printf("Testing empty corpus           ");
+	test_evaluate(test_empty());
+
+	test_end();
+}
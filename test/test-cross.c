@@ -0,0 +1,143 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `cross_factors` function. Exactly
+// the pairs of a key of each side with a common factor have to be found,
+// with their gcd.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+static gmp_randstate_t state;
+
+// Compares the found pairs with the gcds of all pairs of `a` and `b`, in
+// the order of `b` and then of `a`.
+static char * check(mpz_array *out, mpz_array *a, mpz_array *b) {
+	mpz_t g;
+	size_t i, j, k = 0;
+
+	mpz_init(g);
+	for (j = 0; j < b->used; j++) {
+		for (i = 0; i < a->used; i++) {
+			mpz_gcd(g, a->array[i], b->array[j]);
+			if (mpz_cmp_ui(g, 1) == 0 || mpz_cmp(a->array[i], b->array[j]) == 0)
+				continue;
+			if (k >= out->used || mpz_cmp(out->array[k], a->array[i]) != 0 ||
+			mpz_cmp(out->array[k+1], b->array[j]) != 0)
+				return "missing pair";
+			if (mpz_cmp(out->array[k+2], g) != 0)
+				return "wrong gcd";
+			k += 3;
+		}
+	}
+	mpz_clear(g);
+	if (k != out->used) return "extra pairs";
+	return 0;
+}
+
+// Side `a` has `na` keys and side `b` has `nb` keys. Every fifth key of
+// `b` shares a prime with a key of `a`, every seventh key of `a` shares a
+// prime with the next key of `a`. The first key of `a` is in `b` too and
+// the second key of `a` is made of the primes of two keys of `b`.
+static char * test(size_t na, size_t nb) {
+	mpz_array a, b, pa, out;
+	mpz_pool pool;
+	mpz_t p, x;
+	size_t i;
+	char *msg;
+
+	pool_init(&pool, 0);
+	array_init(&a, na);
+	array_init(&b, nb);
+	array_init(&pa, na);
+	array_init(&out, 9);
+	mpz_init(p);
+	mpz_init(x);
+	for (i = 0; i < na; i++) {
+		if (i % 7 != 1 || i == 1)
+			test_prime(p, state, 64);
+		array_add(&pa, p);
+		test_prime(x, state, 64);
+		mpz_mul(x, x, p);
+		array_add(&a, x);
+	}
+	for (i = 0; i < nb; i++) {
+		if (i % 5 == 0)
+			mpz_set(p, pa.array[(i * 13) % na]);
+		else
+			test_prime(p, state, 64);
+		test_prime(x, state, 64);
+		mpz_mul(x, x, p);
+		array_add(&b, x);
+	}
+	if (na > 1 && nb > 3) {
+		mpz_set(b.array[nb - 1], a.array[0]);
+		mpz_divexact(p, a.array[1], pa.array[1]);
+		mpz_mul(b.array[1], b.array[1], p);
+		mpz_mul(b.array[2], b.array[2], pa.array[1]);
+	}
+
+	cross_factors(&pool, &out, &a, &b);
+	if ((msg = check(&out, &a, &b)) != 0) return msg;
+
+	array_clear(&a);
+	array_clear(&b);
+	array_clear(&pa);
+	array_clear(&out);
+	mpz_clear(p);
+	mpz_clear(x);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Nothing is found if one side is empty.
+static char * test_empty() {
+	mpz_array a, b, out;
+	mpz_pool pool;
+	mpz_t x;
+
+	pool_init(&pool, 0);
+	mpz_init_set_ui(x, 15);
+	array_init(&a, 1);
+	array_init(&b, 1);
+	array_init(&out, 3);
+	array_add(&a, x);
+	cross_factors(&pool, &out, &a, &b);
+	cross_factors(&pool, &out, &b, &a);
+	if (out.used != 0) return "found keys of an empty side";
+	array_clear(&a);
+	array_clear(&b);
+	array_clear(&out);
+	mpz_clear(x);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting cross test\n");
+	gmp_randinit_default(state);
+
+	printf("Testing 1 x 1 keys             ");
+	test_evaluate(test(1, 1));
+
+	printf("Testing 20 x 30 keys           ");
+	test_evaluate(test(20, 30));
+
+	printf("Testing 200 x 50 keys          ");
+	test_evaluate(test(200, 50));
+
+	printf("Testing empty side             ");
+	test_evaluate(test_empty());
+
+	gmp_randclear(state);
+	test_end();
+}
@@ -0,0 +1,141 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [hash](hash.html) `mpz_fingerprint` and `array_dedup` functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "hash.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Equal integers have equal fingerprints.
+static char * test_fingerprint() {
+	mpz_t a, b;
+
+	mpz_init_set_str(a, "938474857283938474857283938474857283938474857283", 10);
+	mpz_init_set_str(b, "938474857283938474857283938474857283938474857283", 10);
+	if (mpz_fingerprint(a) != mpz_fingerprint(b))
+		return "equal integers differ";
+	mpz_add_ui(b, b, 1);
+	if (mpz_fingerprint(a) == mpz_fingerprint(b))
+		return "different integers collide";
+	mpz_neg(b, a);
+	if (mpz_fingerprint(a) == mpz_fingerprint(b))
+		return "sign is ignored";
+
+	mpz_clear(a);
+	mpz_clear(b);
+	return 0;
+}
+
+// Remove the duplicates of a small array and check the map.
+static char * test_dedup() {
+	mpz_array a;
+	mpz_t b;
+	size_t map[7], removed;
+	const unsigned long in[7] = {5, 3, 5, 7, 3, 5, 11};
+	const unsigned long expect[4] = {5, 3, 7, 11};
+	const size_t expect_map[7] = {0, 1, 0, 2, 1, 0, 3};
+	size_t i;
+
+	mpz_init(b);
+	array_init(&a, 2);
+	for (i = 0; i < 7; i++) {
+		mpz_set_ui(b, in[i]);
+		array_add(&a, b);
+	}
+
+	removed = array_dedup(&a, map);
+	if (removed != 3) return "wrong duplicate count";
+	if (a.used != 4) return "wrong unique count";
+	for (i = 0; i < a.used; i++) {
+		if (mpz_cmp_ui(a.array[i], expect[i]) != 0)
+			return "order of uniques changed";
+	}
+	for (i = 0; i < 7; i++) {
+		if (map[i] != expect_map[i])
+			return "wrong canonical index";
+	}
+
+	mpz_clear(b);
+	array_clear(&a);
+	return 0;
+}
+
+// Compare `array_dedup` with `array_msort` and `array_unique` on
+// `size` random integers with many duplicates.
+static char * test_dedup_random(size_t size) {
+	mpz_array a, sorted, uniques;
+	mpz_t b;
+	size_t i, *map;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(b);
+	array_init(&a, size);
+	for (i = 0; i < size; i++) {
+		mpz_urandomb(b, state, 1024);
+		array_add(&a, b);
+		// Every third integer is followed by a duplicate.
+		if (i % 3 == 2) {
+			mpz_set(b, a.array[a.used / 2]);
+			array_add(&a, b);
+		}
+	}
+	size = a.used;
+	map = (size_t *)malloc(size * sizeof(size_t));
+
+	array_init(&sorted, size);
+	array_add_array(&sorted, &a);
+	array_msort(&sorted);
+	array_init(&uniques, size);
+	array_unique(&uniques, &sorted);
+
+	// Keep a copy to verify the map.
+	array_clear(&sorted);
+	array_init(&sorted, size);
+	array_add_array(&sorted, &a);
+
+	array_dedup(&a, map);
+	if (a.used != uniques.used) return "unique count differs";
+	for (i = 0; i < size; i++) {
+		if (mpz_cmp(sorted.array[i], a.array[map[i]]) != 0)
+			return "map points to a different integer";
+	}
+	array_msort(&a);
+	if (!array_equal(&a, &uniques)) return "uniques differ";
+
+	free(map);
+	mpz_clear(b);
+	gmp_randclear(state);
+	array_clear(&a);
+	array_clear(&sorted);
+	array_clear(&uniques);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting dedup test\n");
+
+	printf("Testing fingerprint            ");
+	test_evaluate(test_fingerprint());
+
+	printf("Testing dedup                  ");
+	test_evaluate(test_dedup());
+
+	printf("Testing dedup 100              ");
+	test_evaluate(test_dedup_random(100));
+
+	printf("Testing dedup 20000            ");
+	test_evaluate(test_dedup_random(20000));
+
+	test_end();
+}
@@ -0,0 +1,108 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [extsort](extsort.html) `extsort` and `extsort_to_file` functions.
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "extsort.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+static const char *inputs[] = {"test/extsort-1.lst", "test/extsort-2.lst"};
+
+// Writes two input files with `size` random integers each. The second
+// file repeats every fourth integer of the first one.
+static void write_inputs(mpz_array *all, size_t size) {
+	mpz_array a, b;
+	mpz_t x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(x);
+	array_init(&a, size);
+	array_init(&b, size);
+	for (i = 0; i < size; i++) {
+		mpz_urandomb(x, state, 128 + (i % 7) * 128);
+		array_add(&a, x);
+		if (i % 4 == 0) {
+			array_add(&b, x);
+		} else {
+			mpz_urandomb(x, state, 1024);
+			array_add(&b, x);
+		}
+	}
+	unlink(inputs[0]);
+	unlink(inputs[1]);
+	array_to_file(&a, inputs[0]);
+	array_to_file(&b, inputs[1]);
+	array_add_array(all, &a);
+	array_add_array(all, &b);
+	array_clear(&a);
+	array_clear(&b);
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+// Sort with a memory budget of `budget` bytes and compare the result with
+// `array_msort` (and `array_unique` if `dedup` is set).
+static char * test_sort(size_t size, size_t budget, int dedup) {
+	mpz_array all, expect, out;
+	extsort_stats stats;
+
+	array_init(&all, 2 * size);
+	array_init(&expect, 2 * size);
+	array_init(&out, 2 * size);
+	write_inputs(&all, size);
+
+	array_msort(&all);
+	if (dedup) {
+		array_unique(&expect, &all);
+	} else {
+		array_add_array(&expect, &all);
+	}
+
+	unlink("test/extsort.out");
+	if (extsort_to_file("test/extsort.out", inputs, 2, budget, dedup, "test", &stats) != 0)
+		return "extsort failed";
+	if (stats.read != all.used) return "wrong read count";
+	if (stats.written != expect.used) return "wrong write count";
+	if (budget < 2 * size * 32 && stats.runs < 2) return "expected multiple runs";
+	array_of_file(&out, "test/extsort.out");
+	if (!array_equal(&out, &expect)) return "output is not sorted";
+
+	array_clear(&all);
+	array_clear(&expect);
+	array_clear(&out);
+	unlink("test/extsort.out");
+	unlink(inputs[0]);
+	unlink(inputs[1]);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting extsort test\n");
+
+	printf("Testing in memory              ");
+	test_evaluate(test_sort(100, 1 << 24, 0));
+
+	printf("Testing runs                   ");
+	test_evaluate(test_sort(1000, 8192, 0));
+
+	printf("Testing runs unique            ");
+	test_evaluate(test_sort(1000, 8192, 1));
+
+	printf("Testing multi pass unique      ");
+	test_evaluate(test_sort(5000, 200000, 1));
+
+	test_end();
+}
@@ -0,0 +1,169 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [fixed](fixed.html) `fixed_kernel_for` and `fixed_width` functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "fixed.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Sets `x` to a random integer with exactly `bits` bit.
+static void random_key(mpz_t x, gmp_randstate_t state, size_t bits) {
+	mpz_urandomb(x, state, bits);
+	mpz_setbit(x, bits - 1);
+}
+
+// Compare the kernel for `bits` with `mpz_mul` and `mpz_gcd`. Every
+// second pair shares a factor, some operands are even.
+static char * test_kernel(size_t bits) {
+	const fixed_kernel *k;
+	mpz_t a, b, f, big, r, e;
+	size_t i;
+	gmp_randstate_t state;
+
+	k = fixed_kernel_for(bits / GMP_NUMB_BITS);
+	if (k == NULL) return "no kernel";
+	if (k->bits != bits) return "wrong kernel";
+
+	gmp_randinit_default(state);
+	mpz_init(a);
+	mpz_init(b);
+	mpz_init(f);
+	mpz_init(big);
+	mpz_init(r);
+	mpz_init(e);
+	for (i = 0; i < 200; i++) {
+		random_key(a, state, bits);
+		random_key(b, state, bits);
+		if (i % 2 == 0) {
+			// a and b share the factor f.
+			random_key(f, state, 64 + i);
+			mpz_fdiv_q_2exp(a, a, 64 + i);
+			mpz_mul(a, a, f);
+			mpz_fdiv_q_2exp(b, b, 64 + i);
+			mpz_mul(b, b, f);
+			if (mpz_size(a) != k->limbs || mpz_size(b) != k->limbs)
+				continue;
+		}
+		if (i % 3 != 0) {
+			mpz_setbit(a, 0);
+		}
+		if (i % 5 == 0) {
+			mpz_setbit(b, 0);
+		}
+
+		k->mul(r, a, b);
+		mpz_mul(e, a, b);
+		if (mpz_cmp(r, e) != 0) return "mul differs";
+
+		k->gcd(r, a, b);
+		mpz_gcd(e, a, b);
+		if (mpz_cmp(r, e) != 0) return "gcd differs";
+
+		// A bigger second operand is reduced first.
+		random_key(big, state, 3 * bits + i);
+		if (i % 4 == 0)
+			mpz_mul(big, big, a);
+		k->gcd(r, a, big);
+		mpz_gcd(e, a, big);
+		if (mpz_cmp(r, e) != 0) return "gcd with big integer differs";
+	}
+
+	mpz_clear(a);
+	mpz_clear(b);
+	mpz_clear(f);
+	mpz_clear(big);
+	mpz_clear(r);
+	mpz_clear(e);
+	gmp_randclear(state);
+	return 0;
+}
+
+// The width is only found if all integers have the same limb count.
+static char * test_width() {
+	mpz_array a;
+	mpz_t x;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(x);
+	array_init(&a, 4);
+
+	if (fixed_width(&a) != 0) return "width of empty array";
+	random_key(x, state, 1024);
+	array_add(&a, x);
+	random_key(x, state, 1000);
+	array_add(&a, x);
+	if (fixed_width(&a) != 1024 / GMP_NUMB_BITS) return "wrong width";
+	random_key(x, state, 2048);
+	array_add(&a, x);
+	if (fixed_width(&a) != 0) return "mixed widths";
+	if (fixed_kernel_for(0) != NULL) return "kernel for width 0";
+	if (fixed_kernel_for(3) != NULL) return "kernel for 3 limbs";
+
+	array_clear(&a);
+	mpz_clear(x);
+	gmp_randclear(state);
+	return 0;
+}
+
+// `prod` uses the kernel for pairs of keys.
+static char * test_prod() {
+	mpz_array a;
+	mpz_t x, p, e;
+	size_t i;
+	mpz_pool pool;
+	gmp_randstate_t state;
+
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	mpz_init(x);
+	mpz_init(p);
+	mpz_init_set_ui(e, 1);
+	array_init(&a, 100);
+	for (i = 0; i < 100; i++) {
+		random_key(x, state, 2048);
+		array_add(&a, x);
+		mpz_mul(e, e, x);
+	}
+	array_prod(&pool, &a, p);
+	if (mpz_cmp(p, e) != 0) return "prod differs";
+
+	array_clear(&a);
+	mpz_clear(x);
+	mpz_clear(p);
+	mpz_clear(e);
+	gmp_randclear(state);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting fixed test\n");
+
+	printf("Testing 1024 bit kernel        ");
+	test_evaluate(test_kernel(1024));
+
+	printf("Testing 2048 bit kernel        ");
+	test_evaluate(test_kernel(2048));
+
+	printf("Testing 4096 bit kernel        ");
+	test_evaluate(test_kernel(4096));
+
+	printf("Testing width                  ");
+	test_evaluate(test_width());
+
+	printf("Testing prod                   ");
+	test_evaluate(test_prod());
+
+	test_end();
+}
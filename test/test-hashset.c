@@ -0,0 +1,110 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [hash](hash.html) `hashset_*` functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "hash.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Insert some integers into an to small set and look them up.
+static char * test_insert() {
+	mpz_hashset h;
+	mpz_t b;
+	size_t g;
+
+	mpz_init(b);
+	hashset_init(&h, 2); // to small
+
+	for (g = 1; g <= 100; g++) {
+		mpz_set_ui(b, g * 7919);
+		if (!hashset_insert(&h, b))
+			return "insert failed";
+	}
+	if (h.used != 100) return "wrong size";
+
+	// A second insert is ignored.
+	mpz_set_ui(b, 7919);
+	if (hashset_insert(&h, b))
+		return "duplicate inserted";
+
+	for (g = 1; g <= 100; g++) {
+		mpz_set_ui(b, g * 7919);
+		if (!hashset_contains(&h, b))
+			return "integer is missing";
+		mpz_add_ui(b, b, 1);
+		if (hashset_contains(&h, b))
+			return "unexpected integer found";
+	}
+
+	hashset_clear(&h);
+	mpz_clear(b);
+	return 0;
+}
+
+// Compare the bulk query of `size` random integers with `array_contains`.
+static char * test_query(size_t size) {
+	mpz_hashset h;
+	mpz_array known, queries;
+	mpz_t b;
+	size_t i, count, expect = 0;
+	char *found;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(b);
+	array_init(&known, size);
+	array_init(&queries, size);
+	for (i = 0; i < size; i++) {
+		mpz_urandomb(b, state, 1024);
+		array_add(&known, b);
+		// Every second query is a known integer.
+		if (i % 2 == 0)
+			mpz_urandomb(b, state, 1024);
+		array_add(&queries, b);
+	}
+
+	hashset_init(&h, 0);
+	hashset_add_array(&h, &known);
+	found = (char *)malloc(size);
+	count = hashset_query(&h, &queries, found);
+
+	for (i = 0; i < size; i++) {
+		if (found[i] != array_contains(&known, queries.array[i]))
+			return "query differs from array_contains";
+		expect += found[i];
+	}
+	if (count != expect) return "wrong query count";
+
+	free(found);
+	hashset_clear(&h);
+	array_clear(&known);
+	array_clear(&queries);
+	mpz_clear(b);
+	gmp_randclear(state);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting hashset test\n");
+
+	printf("Testing insert                 ");
+	test_evaluate(test_insert());
+
+	printf("Testing query 100              ");
+	test_evaluate(test_query(100));
+
+	printf("Testing query 5000             ");
+	test_evaluate(test_query(5000));
+
+	test_end();
+}
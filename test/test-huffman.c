@@ -0,0 +1,109 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `huffman_prod` and `array_huffman_prod` functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// **Test `huffman_prod`** against `prod` for `size` integers of very
+// different sizes (16 bit to 64 kbit).
+static char * test_skewed(size_t size) {
+	mpz_array a, copy;
+	mpz_t x, p, h;
+	size_t g;
+	mpz_pool pool;
+	gmp_randstate_t state;
+
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	mpz_init(x);
+	mpz_init(p);
+	mpz_init(h);
+	array_init(&a, size);
+	array_init(&copy, size);
+
+	for (g = 0; g < size; g++) {
+		mpz_urandomb(x, state, 16 << (g * 7 % 13));
+		mpz_add_ui(x, x, 1);
+		array_add(&a, x);
+	}
+	array_add_array(&copy, &a);
+
+	prod(&pool, p, a.array, 0, a.used-1);
+	huffman_prod(&pool, h, a.array, 0, a.used-1);
+
+	if (mpz_cmp(p, h) != 0) return "calculation error";
+	if (!array_equal(&a, &copy)) return "array is modified";
+	if (pool.used != 0) return "pool integers in use";
+
+	mpz_clear(x);
+	mpz_clear(p);
+	mpz_clear(h);
+	array_clear(&a);
+	array_clear(&copy);
+	gmp_randclear(state);
+	pool_clear(&pool);
+	return 0;
+}
+
+// **Test the `array` wrapper**.
+static char * test_array_huffman_prod() {
+	mpz_array a;
+	mpz_t p, r;
+	size_t g;
+	mpz_pool pool;
+
+	pool_init(&pool, 0);
+	mpz_init(r);
+	mpz_init(p);
+	array_init(&a, 4);
+
+	// The empty product is 1.
+	array_huffman_prod(&pool, &a, r);
+	if (mpz_cmp_ui(r, 1) != 0) return "empty product is not 1";
+
+	// 10! = 3628800
+	for(g=1;g<=10;g++) {
+		mpz_set_ui(p, g);
+		array_add(&a, p);
+	}
+	array_huffman_prod(&pool, &a, r);
+	if (mpz_cmp_ui(r, 3628800) != 0) return "calculation error";
+
+	array_clear(&a);
+	mpz_clear(p);
+	mpz_clear(r);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Run all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting huffman test\n");
+
+	printf("Testing 1 integer              ");
+	test_evaluate(test_skewed(1));
+
+	printf("Testing 3 integers             ");
+	test_evaluate(test_skewed(3));
+
+	printf("Testing 100 integers           ");
+	test_evaluate(test_skewed(100));
+
+	printf("Testing 1000 integers          ");
+	test_evaluate(test_skewed(1000));
+
+	printf("Testing array wrapper          ");
+	test_evaluate(test_array_huffman_prod());
+
+	test_end();
+}
@@ -0,0 +1,77 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of the [copri](copri.html) leaf size of `cb` and
+// `find_factors`. The direct computation of small subsets has to give the
+// same results as the recursion down to single integers.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Compute the coprime base and the factors of `s` with leaf size `leaf`.
+static void run(mpz_array *s, size_t leaf, mpz_array *base,
+mpz_array *factors) {
+	mpz_pool pool;
+
+	pool_init(&pool, 0);
+	copri_set_leaf(leaf);
+	array_cb(&pool, base, s);
+	array_msort(base);
+	array_find_factors(&pool, factors, s, base);
+	copri_set_leaf(1);
+	pool_clear(&pool);
+}
+
+// Compare leaf size `leaf` with the full recursion for `size` keys.
+static char * test_leaf(size_t size, size_t leaf) {
+	mpz_array s, base_1, base_l, factors_1, factors_l;
+
+	array_init(&s, size);
+	array_init(&base_1, size);
+	array_init(&base_l, size);
+	array_init(&factors_1, size);
+	array_init(&factors_l, size);
+	test_keys(&s, size, 0, 1);
+
+	run(&s, 1, &base_1, &factors_1);
+	run(&s, leaf, &base_l, &factors_l);
+
+	if (base_1.used < 2) return "trivial coprime base";
+	if (!array_equal(&base_1, &base_l)) return "cb differs";
+	if (factors_1.used == 0) return "no factors found";
+	if (!array_equal(&factors_1, &factors_l)) return "find_factors differs";
+
+	array_clear(&s);
+	array_clear(&base_1);
+	array_clear(&base_l);
+	array_clear(&factors_1);
+	array_clear(&factors_l);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting leaf test\n");
+
+	printf("Testing leaf 2                 ");
+	test_evaluate(test_leaf(100, 2));
+
+	printf("Testing leaf 5                 ");
+	test_evaluate(test_leaf(100, 5));
+
+	printf("Testing leaf 16                ");
+	test_evaluate(test_leaf(300, 16));
+
+	printf("Testing leaf > size            ");
+	test_evaluate(test_leaf(20, 64));
+
+	test_end();
+}
@@ -0,0 +1,98 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) prepared modulus functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "config.h"
+#if USE_OPENMP
+#include <omp.h>
+#endif
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Reduce random integers of 1 to 20 times the size of a modulus with
+// `bits` bit and compare with `mpz_fdiv_r` and `ppi_ppo`. If `threads`
+// is 9 the reciprocal is used.
+static char * test(size_t bits, int threads) {
+	copri_modulus m;
+	mpz_t n, a, r, e, ppi, ppo, eppi, eppo;
+	mpz_pool pool;
+	size_t i;
+	gmp_randstate_t state;
+
+#if USE_OPENMP
+	omp_set_num_threads(threads);
+#endif
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	mpz_init(n);
+	mpz_init(a);
+	mpz_init(r);
+	mpz_init(e);
+	mpz_init(ppi);
+	mpz_init(ppo);
+	mpz_init(eppi);
+	mpz_init(eppo);
+	mpz_urandomb(n, state, bits);
+	mpz_setbit(n, bits - 1);
+	modulus_init(&m, n);
+#if USE_OPENMP
+	if (threads == 9 && m.p == 0) return "no reciprocal";
+#endif
+
+	for (i = 1; i <= 20; i++) {
+		mpz_urandomb(a, state, i * bits + 17 * i);
+		if (i % 3 == 0)
+			mpz_mul(a, a, n);
+		modulus_fdiv_r(r, a, &m);
+		mpz_fdiv_r(e, a, n);
+		if (mpz_cmp(r, e) != 0) return "remainder differs";
+
+		// a shares the primes of n / 3 with n.
+		mpz_fdiv_q_ui(e, n, 3);
+		mpz_mul(a, a, e);
+		modulus_ppi_ppo(&pool, ppi, ppo, a, &m);
+		ppi_ppo(&pool, eppi, eppo, a, n);
+		if (mpz_cmp(ppi, eppi) != 0) return "ppi differs";
+		if (mpz_cmp(ppo, eppo) != 0) return "ppo differs";
+	}
+
+	modulus_clear(&m);
+	mpz_clear(n);
+	mpz_clear(a);
+	mpz_clear(r);
+	mpz_clear(e);
+	mpz_clear(ppi);
+	mpz_clear(ppo);
+	mpz_clear(eppi);
+	mpz_clear(eppo);
+	gmp_randclear(state);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting modulus test\n");
+
+	copri_set_mul_threshold(4);
+
+	printf("Testing without reciprocal     ");
+	test_evaluate(test(3000, 1));
+
+	printf("Testing with reciprocal        ");
+	test_evaluate(test(3000, 9));
+
+	printf("Testing uneven limbs           ");
+	test_evaluate(test(64 * 5 + 1, 9));
+
+	test_end();
+}
@@ -0,0 +1,140 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `parallel_fdiv_qr` and `parallel_gcd` functions.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "config.h"
+#if USE_OPENMP
+#include <omp.h>
+#endif
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Compare the division and gcd of random integers with `abits` and
+// `dbits` bit with GMP. If `common` is set, `a` is a multiple of `d`.
+static char * test(size_t abits, size_t dbits, int common) {
+	mpz_t a, d, q, r, eq, er;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(a);
+	mpz_init(d);
+	mpz_init(q);
+	mpz_init(r);
+	mpz_init(eq);
+	mpz_init(er);
+	mpz_urandomb(a, state, abits);
+	mpz_setbit(a, abits - 1);
+	mpz_urandomb(d, state, dbits);
+	mpz_setbit(d, dbits - 1);
+	if (common)
+		mpz_mul(a, a, d);
+
+	parallel_fdiv_qr(q, r, a, d);
+	mpz_fdiv_qr(eq, er, a, d);
+	if (mpz_cmp(q, eq) != 0) return "quotient differs";
+	if (mpz_cmp(r, er) != 0) return "remainder differs";
+
+	parallel_fdiv_q(q, a, d);
+	if (mpz_cmp(q, eq) != 0) return "quotient of fdiv_q differs";
+
+	parallel_gcd(q, a, d);
+	mpz_gcd(eq, a, d);
+	if (mpz_cmp(q, eq) != 0) return "gcd differs";
+	parallel_gcd(q, d, a);
+	if (mpz_cmp(q, eq) != 0) return "swapped gcd differs";
+
+	mpz_clear(a);
+	mpz_clear(d);
+	mpz_clear(q);
+	mpz_clear(r);
+	mpz_clear(eq);
+	mpz_clear(er);
+	gmp_randclear(state);
+	return 0;
+}
+
+// `gcd_ppi_ppo` with the parallel kernels.
+static char * test_ppi_ppo() {
+	mpz_t a, b, p, gcd, ppi, ppo, e;
+	mpz_pool pool;
+	gmp_randstate_t state;
+
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	mpz_init(a);
+	mpz_init(b);
+	mpz_init(p);
+	mpz_init(gcd);
+	mpz_init(ppi);
+	mpz_init(ppo);
+	mpz_init(e);
+
+	// a = p^3 x, b = p y with odd x and y
+	mpz_urandomb(p, state, 5000);
+	mpz_setbit(p, 0);
+	mpz_urandomb(a, state, 90000);
+	mpz_setbit(a, 0);
+	mpz_urandomb(b, state, 20000);
+	mpz_setbit(b, 0);
+	mpz_mul(b, b, p);
+	mpz_mul(a, a, p);
+	mpz_mul(a, a, p);
+	mpz_mul(e, a, p);
+	mpz_set(a, e);
+
+	gcd_ppi_ppo(&pool, gcd, ppi, ppo, a, b);
+	mpz_mul(e, ppi, ppo);
+	if (mpz_cmp(e, a) != 0) return "ppi * ppo differs";
+	mpz_gcd(e, ppo, b);
+	if (mpz_cmp_ui(e, 1) != 0) return "ppo not coprime";
+	mpz_gcd(e, a, b);
+	if (mpz_cmp(gcd, e) != 0) return "gcd differs";
+
+	mpz_clear(a);
+	mpz_clear(b);
+	mpz_clear(p);
+	mpz_clear(gcd);
+	mpz_clear(ppi);
+	mpz_clear(ppo);
+	mpz_clear(e);
+	gmp_randclear(state);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting pardiv test\n");
+
+	// Use 9 threads, i.e. 3x3 blocks, and a low threshold.
+#if USE_OPENMP
+	omp_set_num_threads(9);
+#endif
+	copri_set_mul_threshold(4);
+
+	printf("Testing big quotient           ");
+	test_evaluate(test(200000, 30000, 0));
+
+	printf("Testing balanced               ");
+	test_evaluate(test(60000, 50000, 0));
+
+	printf("Testing exact division         ");
+	test_evaluate(test(100000, 40000, 1));
+
+	printf("Testing small divisor          ");
+	test_evaluate(test(100000, 100, 0));
+
+	printf("Testing gcd_ppi_ppo            ");
+	test_evaluate(test_ppi_ppo());
+
+	test_end();
+}
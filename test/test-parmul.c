@@ -0,0 +1,118 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of [copri](copri.html) `parallel_mul` function.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+#include "config.h"
+#if USE_OPENMP
+#include <omp.h>
+#endif
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Compare the product of random integers with `abits` and `bbits` bit
+// with `mpz_mul`, also for a square and an aliased result.
+static char * test(size_t abits, size_t bbits) {
+	mpz_t a, b, r, e;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(a);
+	mpz_init(b);
+	mpz_init(r);
+	mpz_init(e);
+	mpz_urandomb(a, state, abits);
+	mpz_setbit(a, abits - 1);
+	mpz_urandomb(b, state, bbits);
+	mpz_setbit(b, bbits - 1);
+
+	parallel_mul(r, a, b);
+	mpz_mul(e, a, b);
+	if (mpz_cmp(r, e) != 0) return "product differs";
+
+	mpz_neg(b, b);
+	parallel_mul(r, a, b);
+	mpz_mul(e, a, b);
+	if (mpz_cmp(r, e) != 0) return "negative product differs";
+
+	mpz_mul(e, a, a);
+	parallel_mul(a, a, a);
+	if (mpz_cmp(a, e) != 0) return "square differs";
+
+	mpz_clear(a);
+	mpz_clear(b);
+	mpz_clear(r);
+	mpz_clear(e);
+	gmp_randclear(state);
+	return 0;
+}
+
+// `prod` and `two_power` use the parallel multiplication.
+static char * test_prod() {
+	mpz_array a;
+	mpz_t x, p, e;
+	size_t i;
+	mpz_pool pool;
+	gmp_randstate_t state;
+
+	pool_init(&pool, 0);
+	gmp_randinit_default(state);
+	mpz_init(x);
+	mpz_init(p);
+	mpz_init_set_ui(e, 1);
+	array_init(&a, 64);
+	for (i = 0; i < 64; i++) {
+		mpz_urandomb(x, state, 1000 + 37 * i);
+		mpz_setbit(x, 0);
+		array_add(&a, x);
+		mpz_mul(e, e, x);
+	}
+	array_prod(&pool, &a, p);
+	if (mpz_cmp(p, e) != 0) return "prod differs";
+
+	mpz_set_ui(x, 3);
+	two_power(x, 12);
+	mpz_ui_pow_ui(e, 3, 4096);
+	if (mpz_cmp(x, e) != 0) return "two_power differs";
+
+	array_clear(&a);
+	mpz_clear(x);
+	mpz_clear(p);
+	mpz_clear(e);
+	gmp_randclear(state);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting parmul test\n");
+
+	// Use 4 threads, i.e. 2x2 blocks, and a low threshold.
+#if USE_OPENMP
+	omp_set_num_threads(4);
+#endif
+	copri_set_mul_threshold(4);
+
+	printf("Testing equal sizes            ");
+	test_evaluate(test(100000, 100000));
+
+	printf("Testing different sizes        ");
+	test_evaluate(test(100000, 3000));
+
+	printf("Testing uneven blocks          ");
+	test_evaluate(test(64 * 9 + 5, 64 * 7 + 3));
+
+	printf("Testing prod and two_power     ");
+	test_evaluate(test_prod());
+
+	test_end();
+}
@@ -0,0 +1,193 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of the [registry](registry.html) of known factors and of
+// the [copri](copri.html) `corpus_gcds` function. The keys with a known
+// factor have to be caught with their factors, all other keys have to be
+// passed on.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "test.h"
+#include "registry.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+static gmp_randstate_t state;
+
+// The gcds of the remainder tree are the gcds of the keys with the
+// product of the corpus.
+static char * test_gcds(size_t count, size_t size) {
+	mpz_array s, p, g;
+	copri_corpus c;
+	mpz_pool pool;
+	mpz_t x, y;
+	size_t i;
+
+	pool_init(&pool, 0);
+	array_init(&s, count);
+	array_init(&p, size);
+	array_init(&g, count);
+	mpz_init(x);
+	mpz_init(y);
+	for (i = 0; i < size; i++) {
+		test_prime(x, state, 64);
+		array_add(&p, x);
+	}
+	for (i = 0; i < count; i++) {
+		test_prime(x, state, 64);
+		if (i % 4 == 0 && size > 0)
+			mpz_mul(x, x, p.array[i % size]);
+		else
+			mpz_mul_2exp(x, x, i % 3);
+		array_add(&s, x);
+	}
+
+	corpus_init(&c, p.array, p.used);
+	corpus_gcds(&pool, &g, &c, &s);
+	if (g.used != s.used) return "wrong gcd count";
+	array_prod(&pool, &p, y);
+	if (size == 0)
+		mpz_set_ui(y, 1);
+	for (i = 0; i < count; i++) {
+		mpz_gcd(x, y, s.array[i]);
+		if (mpz_cmp(x, g.array[i]) != 0) return "wrong gcd";
+	}
+	corpus_clear(&c);
+
+	array_clear(&s);
+	array_clear(&p);
+	array_clear(&g);
+	mpz_clear(x);
+	mpz_clear(y);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Keys with one known factor, with two known factors, a known factor
+// itself, a key which shares only the cofactor of a caught key and keys
+// without known factors.
+static char * test_filter() {
+	copri_registry r;
+	mpz_array s, out, rest;
+	mpz_pool pool;
+	mpz_t a, b, c, d, x;
+	size_t caught;
+
+	pool_init(&pool, 0);
+	registry_init(&r);
+	array_init(&s, 8);
+	array_init(&out, 8);
+	array_init(&rest, 8);
+	mpz_init(a);
+	mpz_init(b);
+	mpz_init(c);
+	mpz_init(d);
+	mpz_init(x);
+	test_prime(a, state, 64);
+	test_prime(b, state, 64);
+	test_prime(c, state, 64);
+	test_prime(d, state, 64);
+	registry_add(&r, a);
+	registry_add(&r, b);
+	if (registry_add(&r, a) != 0) return "known factor added twice";
+
+	mpz_mul(x, a, c);
+	array_add(&s, x);
+	mpz_mul(x, a, b);
+	array_add(&s, x);
+	array_add(&s, b);
+	mpz_mul(x, c, d);
+	array_add(&s, x);
+	test_prime(x, state, 64);
+	mpz_mul(x, x, x);
+	array_add(&s, x);
+
+	caught = registry_filter(&pool, &r, &out, &rest, &s);
+	if (caught != 3 || out.used != 9) return "wrong count of caught keys";
+	if (rest.used != 2) return "wrong count of other keys";
+	mpz_mul(x, a, c);
+	if (mpz_cmp(out.array[0], x) != 0 || mpz_cmp(out.array[1], a) != 0 ||
+	mpz_cmp(out.array[2], c) != 0)
+		return "wrong factors of a key";
+	mpz_mul(x, out.array[4], out.array[5]);
+	if (mpz_cmp(out.array[3], x) != 0 || mpz_cmp_ui(out.array[4], 1) == 0 ||
+	mpz_cmp_ui(out.array[5], 1) == 0)
+		return "wrong factors of known factors";
+	mpz_mul(x, c, d);
+	if (mpz_cmp(out.array[6], x) != 0 || mpz_cmp(out.array[7], c) != 0)
+		return "key of a new factor not caught";
+	if (mpz_cmp(rest.array[0], b) != 0) return "known factor caught";
+	if (r.primes.used != 4) return "cofactors not added";
+
+	array_clear(&s);
+	array_clear(&out);
+	array_clear(&rest);
+	mpz_clear(a);
+	mpz_clear(b);
+	mpz_clear(c);
+	mpz_clear(d);
+	mpz_clear(x);
+	registry_clear(&r);
+	pool_clear(&pool);
+	return 0;
+}
+
+// Only the new factors are appended to the file.
+static char * test_file() {
+	copri_registry r, l;
+	mpz_t x;
+	char name[] = "/tmp/copri-registry-XXXXXX";
+	int fd = mkstemp(name);
+
+	if (fd < 0) return "can't create a file";
+	close(fd);
+	mpz_init(x);
+	registry_init(&r);
+	registry_init(&l);
+	test_prime(x, state, 64);
+	registry_add(&r, x);
+	if (registry_to_file(&r, name) != 1) return "factor not stored";
+	if (registry_to_file(&r, name) != 0) return "factor stored twice";
+	test_prime(x, state, 64);
+	registry_add(&r, x);
+	if (registry_to_file(&r, name) != 1) return "new factor not stored";
+	if (registry_of_file(&l, name) != 2) return "wrong count of loaded factors";
+	if (!hashset_contains(&l.primes, x)) return "factor not loaded";
+	if (registry_to_file(&l, name) != 0) return "loaded factors stored";
+
+	unlink(name);
+	registry_clear(&r);
+	registry_clear(&l);
+	mpz_clear(x);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting registry test\n");
+	gmp_randinit_default(state);
+
+	printf("Testing gcds of 1 key          ");
+	test_evaluate(test_gcds(1, 3));
+
+	printf("Testing gcds of 100 keys       ");
+	test_evaluate(test_gcds(100, 7));
+
+	printf("Testing gcds without factors   ");
+	test_evaluate(test_gcds(10, 0));
+
+	printf("Testing filter                 ");
+	test_evaluate(test_filter());
+
+	printf("Testing file                   ");
+	test_evaluate(test_file());
+
+	gmp_randclear(state);
+	test_end();
+}
@@ -0,0 +1,116 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of the [copri](copri.html) split strategies. The split by
+// bit length has to give the same results as the split by count.
+#include <stdlib.h>
+#include <stdio.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Creates `size` keys of very different sizes (64 to 2048 bit). Some keys
+// share a prime, so the coprime base is not trivial.
+static void keys(mpz_array *s, size_t size) {
+	mpz_t p, q, x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(p);
+	mpz_init(q);
+	mpz_init(x);
+	for (i = 0; i < size; i++) {
+		if (i % 5 != 4) {
+			mpz_urandomb(p, state, 32 << (i % 7 == 0 ? 5 : i % 3));
+			mpz_nextprime(p, p);
+		}
+		mpz_urandomb(q, state, 32 << (i % 4));
+		mpz_nextprime(q, q);
+		mpz_mul(x, p, q);
+		array_add(s, x);
+	}
+	mpz_clear(p);
+	mpz_clear(q);
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+// Runs `prod`, `split`, `cb` and `find_factors` on `s` with the current
+// split strategy.
+static void run(mpz_array *s, mpz_t r, mpz_array *split_out,
+mpz_array *base, mpz_array *factors) {
+	mpz_pool pool;
+
+	pool_init(&pool, 0);
+	array_prod(&pool, s, r);
+	array_cb(&pool, base, s);
+	array_msort(base);
+	array_split(&pool, split_out, r, base);
+	array_find_factors(&pool, factors, s, base);
+	pool_clear(&pool);
+}
+
+// Compare the results of both strategies for `size` keys.
+static char * test_equal(size_t size) {
+	mpz_array s, split_c, split_b, base_c, base_b, factors_c, factors_b;
+	mpz_t r_c, r_b;
+
+	array_init(&s, size);
+	array_init(&split_c, size);
+	array_init(&split_b, size);
+	array_init(&base_c, size);
+	array_init(&base_b, size);
+	array_init(&factors_c, size);
+	array_init(&factors_b, size);
+	mpz_init(r_c);
+	mpz_init(r_b);
+	keys(&s, size);
+
+	copri_set_split(COPRI_SPLIT_COUNT);
+	run(&s, r_c, &split_c, &base_c, &factors_c);
+	copri_set_split(COPRI_SPLIT_BITS);
+	if (copri_get_split() != COPRI_SPLIT_BITS) return "strategy not set";
+	run(&s, r_b, &split_b, &base_b, &factors_b);
+	copri_set_split(COPRI_SPLIT_COUNT);
+
+	if (mpz_cmp(r_c, r_b) != 0) return "prod differs";
+	if (base_c.used < 2) return "trivial coprime base";
+	if (!array_equal(&base_c, &base_b)) return "cb differs";
+	if (!array_equal(&split_c, &split_b)) return "split differs";
+	if (factors_c.used == 0) return "no factors found";
+	if (!array_equal(&factors_c, &factors_b)) return "find_factors differs";
+
+	array_clear(&s);
+	array_clear(&split_c);
+	array_clear(&split_b);
+	array_clear(&base_c);
+	array_clear(&base_b);
+	array_clear(&factors_c);
+	array_clear(&factors_b);
+	mpz_clear(r_c);
+	mpz_clear(r_b);
+	return 0;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting splitbits test\n");
+
+	printf("Testing 6 keys                 ");
+	test_evaluate(test_equal(6));
+
+	printf("Testing 50 keys                ");
+	test_evaluate(test_equal(50));
+
+	printf("Testing 300 keys               ");
+	test_evaluate(test_equal(300));
+
+	test_end();
+}
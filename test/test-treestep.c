@@ -0,0 +1,126 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This is a test of the [copri](copri.html) product tree step and disk
+// mode. Product trees that keep only some levels or keep them on disk
+// have to give the same results as the complete trees in memory.
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <gmp.h>
+#include "test.h"
+#include "copri.h"
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+// Compute the coprime base, the split of the product of all keys and the
+// factors of `s`.
+static void run(mpz_array *s, mpz_array *base, mpz_array *parts,
+mpz_array *factors) {
+	mpz_pool pool;
+	mpz_t x;
+
+	pool_init(&pool, 0);
+	mpz_init(x);
+	array_cb(&pool, base, s);
+	array_msort(base);
+	array_prod(&pool, s, x);
+	array_split(&pool, parts, x, base);
+	array_find_factors(&pool, factors, s, base);
+	mpz_clear(x);
+	pool_clear(&pool);
+}
+
+// Compare the tree step `step`, the memory budget `bytes` and the tree
+// directory `dir` with the complete trees for `size` keys.
+static char * test(size_t size, size_t step, size_t bytes, const char *dir) {
+	mpz_array s, base_1, base_k, parts_1, parts_k, factors_1, factors_k;
+	size_t disk_bytes = copri_get_tree_disk_bytes();
+
+	array_init(&s, size);
+	array_init(&base_1, size);
+	array_init(&base_k, size);
+	array_init(&parts_1, size);
+	array_init(&parts_k, size);
+	array_init(&factors_1, size);
+	array_init(&factors_k, size);
+	test_keys(&s, size, 0, 0);
+
+	run(&s, &base_1, &parts_1, &factors_1);
+	copri_set_tree_step(step);
+	copri_set_tree_memory(bytes);
+	copri_set_tree_dir(dir);
+	copri_set_tree_disk_bytes(0);
+	run(&s, &base_k, &parts_k, &factors_k);
+	copri_set_tree_step(1);
+	copri_set_tree_memory(0);
+	copri_set_tree_dir(NULL);
+	copri_set_tree_disk_bytes(disk_bytes);
+
+	if (factors_1.used == 0) return "no factors";
+	if (!array_equal(&base_1, &base_k)) return "cb differs";
+	if (!array_equal(&parts_1, &parts_k)) return "split differs";
+	if (!array_equal(&factors_1, &factors_k)) return "factors differ";
+
+	array_clear(&s);
+	array_clear(&base_1);
+	array_clear(&base_k);
+	array_clear(&parts_1);
+	array_clear(&parts_k);
+	array_clear(&factors_1);
+	array_clear(&factors_k);
+	return 0;
+}
+
+// A full disk is simulated with a file size limit, the nodes which could
+// not be written are recomputed.
+static char * test_full(size_t size) {
+	struct rlimit old, full;
+	char *msg;
+
+	getrlimit(RLIMIT_FSIZE, &old);
+	full = old;
+	full.rlim_cur = 4096;
+	signal(SIGXFSZ, SIG_IGN);
+	setrlimit(RLIMIT_FSIZE, &full);
+	msg = test(size, 1, 0, ".");
+	setrlimit(RLIMIT_FSIZE, &old);
+	signal(SIGXFSZ, SIG_DFL);
+	return msg;
+}
+
+// Execute all tests.
+int main(int argc, char **argv) {
+
+	printf("Starting treestep test\n");
+
+	printf("Testing step 2                 ");
+	test_evaluate(test(100, 2, 0, NULL));
+
+	printf("Testing step 3                 ");
+	test_evaluate(test(100, 3, 0, NULL));
+
+	printf("Testing step above depth       ");
+	test_evaluate(test(100, 20, 0, NULL));
+
+	printf("Testing memory budget          ");
+	test_evaluate(test(100, 1, 3000, NULL));
+
+	printf("Testing disk                   ");
+	test_evaluate(test(100, 1, 0, "."));
+
+	printf("Testing disk with step 2       ");
+	test_evaluate(test(100, 2, 0, "."));
+
+	printf("Testing disk above budget      ");
+	test_evaluate(test(300, 1, 3000, "."));
+
+	printf("Testing full disk              ");
+	test_evaluate(test_full(300));
+
+	test_end();
+}
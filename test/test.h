@@ -3,6 +3,9 @@
 // License: GNU Lesser General Public License (LGPL), version 3 or later
 // See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
 
+#include <gmp.h>
+#include "array.h"
+
 #define test_assert(message, test) do { if (!(test)) return message; } while (0)
 
 #define test_evaluate(result) do { if (result != 0) { tests_failed++; printf("FAIL: %s\n", result); } else {tests_passed++; printf("PASS\n"); } } while (0)
@@ -11,3 +14,43 @@
 
 extern int tests_passed;
 extern int tests_failed;
+
+// Sets `x` to a random prime with `bits` bit.
+static inline void test_prime(mpz_t x, gmp_randstate_t state, size_t bits) {
+	mpz_urandomb(x, state, bits);
+	mpz_setbit(x, bits - 1);
+	mpz_nextprime(x, x);
+}
+
+// Creates `size` products of two primes with 64 bit from the random
+// `seed`. Every third key shares a prime with the previous key. With `odd`
+// some keys are squares, repeated or 1 as well.
+static inline void test_keys(mpz_array *s, size_t size, unsigned long seed,
+int odd) {
+	mpz_t p, q, x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	gmp_randseed_ui(state, seed);
+	mpz_init(p);
+	mpz_init(q);
+	mpz_init(x);
+	for (i = 0; i < size; i++) {
+		if (i % 3 != 2)
+			test_prime(p, state, 64);
+		test_prime(q, state, 64);
+		if (odd && i % 11 == 5)
+			mpz_set(q, p);
+		mpz_mul(x, p, q);
+		if (odd && i % 13 == 7)
+			mpz_set_ui(x, 1);
+		array_add(s, x);
+		if (odd && i % 17 == 3)
+			array_add(s, x);
+	}
+	mpz_clear(p);
+	mpz_clear(q);
+	mpz_clear(x);
+	gmp_randclear(state);
+}
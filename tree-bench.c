@@ -0,0 +1,155 @@
+// copri, Attacking RSA by factoring coprimes
+//
+// License: GNU Lesser General Public License (LGPL), version 3 or later
+// See the lgpl.txt file in the root directory or <https://www.gnu.org/licenses/lgpl>.
+
+// This file contains a benchmark of the product tree step, the peak memory
+// against the runtime of `find_factors`.
+//
+// The keys of a synthetic corpus are factored over the primes they are
+// made of, once for every step 1, 2, ... up to the maximal step. Every run
+// is a child process, so its peak resident memory can be reported. With
+// `-d DIR` the kept levels are written to files in DIR.
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <gmp.h>
+#include "copri.h"
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Creates `count` keys with `bits` bit from `count + 1` primes, key i is
+// the product of the primes i and i + 1.
+static void corpus(mpz_array *s, mpz_array *p, size_t count,
+unsigned long bits) {
+	mpz_t q, x;
+	size_t i;
+	gmp_randstate_t state;
+
+	gmp_randinit_default(state);
+	mpz_init(q);
+	mpz_init(x);
+	for (i = 0; i <= count; i++) {
+		mpz_urandomb(q, state, bits / 2);
+		mpz_setbit(q, bits / 2 - 1);
+		mpz_nextprime(q, q);
+		array_add(p, q);
+	}
+	for (i = 0; i < count; i++) {
+		mpz_mul(x, p->array[i], p->array[i + 1]);
+		array_add(s, x);
+	}
+	mpz_clear(q);
+	mpz_clear(x);
+	gmp_randclear(state);
+}
+
+// Runs `find_factors` with tree step `step` in a child process and prints
+// its time and peak memory.
+static int measure(mpz_array *s, mpz_array *p, size_t step) {
+	mpz_pool pool;
+	mpz_array out;
+	struct rusage usage;
+	double t;
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	t = now();
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		pool_init(&pool, 0);
+		array_init(&out, 10);
+		copri_set_tree_step(step);
+		array_find_factors(&pool, &out, s, p);
+		array_clear(&out);
+		pool_clear(&pool);
+		exit(0);
+	}
+	if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) ||
+	WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "Run with step %zu failed\n", step);
+		return 1;
+	}
+	printf("step %3zu: %8.3f s %8.1f MB\n", step, now() - t,
+		usage.ru_maxrss / 1024.0);
+	return 0;
+}
+
+// The generic `main` function.
+//
+// Define all variables at the beginning to make the C99 compiler
+// happy.
+int main(int argc, char **argv) {
+	mpz_array s, p;
+	long int count = 4000, bits = 1024, max = 4;
+	size_t step;
+	int c, errflg = 0, r = 0;
+
+	// #### argument parsing
+	// Boring `getopt` argument parsing.
+	while ((c = getopt(argc, argv, ":n:b:k:d:")) != -1) {
+		switch(c) {
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			bits = strtol(optarg, NULL, 0);
+			break;
+		case 'k':
+			max = strtol(optarg, NULL, 0);
+			break;
+		case 'd':
+			copri_set_tree_dir(optarg);
+			copri_set_tree_disk_bytes(0);
+			break;
+		case ':':
+			fprintf(stderr, "Option -%c requires an operand\n", optopt);
+			errflg++;
+			break;
+		case '?':
+			fprintf(stderr, "Unrecognized option: '-%c'\n", optopt);
+			errflg++;
+		}
+	}
+
+	if (count <= 1 || bits < 16 || max < 1 || optind < argc)
+		errflg++;
+
+	// Print the usage and exit if an error occurred during argument parsing.
+	if (errflg) {
+		fprintf(stderr, "usage: [-n COUNT] [-b BITS] [-k MAX] [-d DIR]\n"\
+                        "\n\t-n COUNT  the count of synthetic keys"\
+                        "\n\t-b BITS   the bit size of the synthetic keys"\
+                        "\n\t-k MAX    the maximal tree step"\
+                        "\n\t-d DIR    keep the product trees in DIR"\
+                        "\n\n");
+		exit(2);
+	}
+
+	array_init(&s, count);
+	array_init(&p, count + 1);
+	corpus(&s, &p, count, bits);
+	printf("%zu keys\n", s.used);
+
+	for (step = 1; step <= max && r == 0; step++) {
+		r = measure(&s, &p, step);
+	}
+
+	array_clear(&s);
+	array_clear(&p);
+	return r;
+}